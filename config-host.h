@@ -0,0 +1,14 @@
+/*
+ * Automatically generated by configure - do not modify
+ * Configured with: * './configure'
+ */
+#define CONFIG_HAVE_KERNEL_RWF_T
+#define CONFIG_HAVE_KERNEL_TIMESPEC
+#define CONFIG_HAVE_OPEN_HOW
+#define CONFIG_HAVE_STATX
+#define CONFIG_HAVE_GLIBC_STATX
+#define CONFIG_HAVE_CXX
+#define CONFIG_HAVE_UCONTEXT
+#define CONFIG_HAVE_STRINGOP_OVERFLOW
+#define CONFIG_HAVE_ARRAY_BOUNDS
+#define CONFIG_HAVE_MEMFD_CREATE
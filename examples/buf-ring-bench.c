@@ -0,0 +1,158 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Compare recycling provided buffers through a registered buffer ring, with
+ * handing them back through IORING_OP_PROVIDE_BUFFERS. Messages are received
+ * from a datagram socketpair in batches, with the kernel picking a buffer
+ * for each, and every buffer is returned once its completion is processed.
+ * Prints the achieved message rate and the number of sqes and cqes that
+ * took, for both methods.
+ *
+ * gcc -Wall -O2 -D_GNU_SOURCE -o buf-ring-bench buf-ring-bench.c -luring
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/socket.h>
+#include "liburing.h"
+
+#define BATCH		32
+#define NR_BUFS		64
+#define BUF_SIZE	64
+#define NR_MSGS		2000000UL
+#define BGID		1
+
+enum {
+	MODE_PROVIDE,
+	MODE_RING,
+};
+
+static char bufs[NR_BUFS][BUF_SIZE];
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(int mode)
+{
+	unsigned long received = 0, nr_sqes = 0, nr_cqes = 0;
+	struct io_uring_buf_ring *br = NULL;
+	struct io_uring_sqe *sqe;
+	struct io_uring ring;
+	char msg[BUF_SIZE];
+	int fds[2], mask, i, ret;
+	double start, elapsed;
+
+	ret = io_uring_queue_init(4 * BATCH, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %s\n", strerror(-ret));
+		return 1;
+	}
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, fds) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+
+	mask = io_uring_buf_ring_mask(NR_BUFS);
+	if (mode == MODE_RING) {
+		br = io_uring_setup_buf_ring(&ring, NR_BUFS, BGID, 0, &ret);
+		if (!br) {
+			fprintf(stderr, "buffer rings not supported: %s\n",
+					strerror(-ret));
+			return 1;
+		}
+		for (i = 0; i < NR_BUFS; i++)
+			io_uring_buf_ring_add(br, bufs[i], BUF_SIZE, i, mask, i);
+		io_uring_buf_ring_advance(br, NR_BUFS);
+	} else {
+		sqe = io_uring_get_sqe(&ring);
+		io_uring_prep_provide_buffers(sqe, bufs, BUF_SIZE, NR_BUFS,
+						BGID, 0);
+		io_uring_submit_and_wait(&ring, 1);
+		io_uring_cq_advance(&ring, 1);
+	}
+
+	memset(msg, 'x', sizeof(msg));
+	start = now();
+	while (received < NR_MSGS) {
+		struct io_uring_cqe *cqe;
+		unsigned head, seen = 0, recycled = 0;
+
+		for (i = 0; i < BATCH; i++) {
+			if (write(fds[1], msg, sizeof(msg)) != sizeof(msg)) {
+				perror("write");
+				return 1;
+			}
+			sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_recv(sqe, fds[0], NULL, BUF_SIZE, 0);
+			sqe->flags |= IOSQE_BUFFER_SELECT;
+			sqe->buf_group = BGID;
+			sqe->user_data = 1;
+		}
+		nr_sqes += BATCH;
+
+		ret = io_uring_submit_and_wait(&ring, BATCH);
+		if (ret < 0) {
+			fprintf(stderr, "submit: %s\n", strerror(-ret));
+			return 1;
+		}
+
+		io_uring_for_each_cqe(&ring, head, cqe) {
+			int bid;
+
+			seen++;
+			/* completion of a PROVIDE_BUFFERS request */
+			if (!cqe->user_data)
+				continue;
+			if (cqe->res != BUF_SIZE) {
+				fprintf(stderr, "recv: %d\n", cqe->res);
+				return 1;
+			}
+			received++;
+			bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+			if (mode == MODE_RING) {
+				io_uring_buf_ring_add(br, bufs[bid], BUF_SIZE,
+						      bid, mask, recycled++);
+				continue;
+			}
+			sqe = io_uring_get_sqe(&ring);
+			io_uring_prep_provide_buffers(sqe, bufs[bid], BUF_SIZE,
+							1, BGID, bid);
+			sqe->user_data = 0;
+			nr_sqes++;
+		}
+		nr_cqes += seen;
+		if (mode == MODE_RING)
+			__io_uring_buf_ring_cq_advance(&ring, br, seen,
+							recycled);
+		else
+			io_uring_cq_advance(&ring, seen);
+	}
+	elapsed = now() - start;
+
+	printf("%-15s %8.0f Kmsgs/sec, %.2f sqes and %.2f cqes per message\n",
+		mode == MODE_RING ? "buffer ring" : "provide buffers",
+		received / elapsed / 1000, (double) nr_sqes / received,
+		(double) nr_cqes / received);
+
+	close(fds[0]);
+	close(fds[1]);
+	if (br)
+		io_uring_free_buf_ring(&ring, br, NR_BUFS, BGID);
+	io_uring_queue_exit(&ring);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	if (run(MODE_PROVIDE))
+		return 1;
+	if (run(MODE_RING))
+		return 1;
+	return 0;
+}
@@ -0,0 +1,290 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Compare passing messages between threads that each own a ring, through
+ * the MSG_RING based io_uring_mailbox, against a mutex protected queue that
+ * wakes the receiver through an eventfd. Each sender is paired with one
+ * receiver, and every thread is pinned to its own CPU where there are
+ * enough of them. Both modes batch the same number of messages per wakeup
+ * and bound the number of messages in flight the same way. Prints the
+ * achieved message rate for 1, 2, 4, ... up to the given number of pairs.
+ *
+ * gcc -Wall -O2 -D_GNU_SOURCE -o mailbox-bench mailbox-bench.c -luring -lpthread
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include <sys/eventfd.h>
+#include "liburing.h"
+
+#define QD		256
+#define CAPACITY	256
+#define BATCH		32
+#define NR_MSGS		1000000UL
+
+enum {
+	MODE_EVENTFD,
+	MODE_MAILBOX,
+};
+
+struct pair {
+	int mode;
+	int cpu;
+
+	/* MODE_MAILBOX */
+	struct io_uring src, dst;
+	struct io_uring_mailbox mb;
+
+	/* MODE_EVENTFD */
+	pthread_mutex_t lock;
+	int efd;
+	unsigned long head, tail;
+	unsigned long msgs[CAPACITY];
+
+	unsigned long sum;
+	pthread_t sender, receiver;
+};
+
+static int nr_cpus;
+
+static void pin(int cpu)
+{
+	cpu_set_t set;
+
+	if (nr_cpus < 2)
+		return;
+	CPU_ZERO(&set);
+	CPU_SET(cpu % nr_cpus, &set);
+	sched_setaffinity(0, sizeof(set), &set);
+}
+
+static int queue_push(struct pair *p, unsigned long msg)
+{
+	int ret = -EAGAIN;
+
+	pthread_mutex_lock(&p->lock);
+	if (p->tail - p->head < CAPACITY) {
+		p->msgs[p->tail++ % CAPACITY] = msg;
+		ret = 0;
+	}
+	pthread_mutex_unlock(&p->lock);
+	return ret;
+}
+
+static void queue_signal(struct pair *p)
+{
+	eventfd_write(p->efd, 1);
+}
+
+static void *sender_fn(void *data)
+{
+	struct pair *p = data;
+	unsigned long i;
+	int ret;
+
+	pin(p->cpu);
+
+	for (i = 1; i <= NR_MSGS; i++) {
+		for (;;) {
+			if (p->mode == MODE_MAILBOX)
+				ret = io_uring_mailbox_send(&p->mb, i);
+			else
+				ret = queue_push(p, i);
+			if (ret != -EAGAIN)
+				break;
+			/* receiver is behind, make sure it has work */
+			if (p->mode == MODE_MAILBOX)
+				io_uring_mailbox_flush(&p->mb);
+			else
+				queue_signal(p);
+			sched_yield();
+		}
+		if (ret) {
+			fprintf(stderr, "send: %s\n", strerror(-ret));
+			exit(1);
+		}
+		if (i % BATCH)
+			continue;
+		if (p->mode == MODE_MAILBOX)
+			io_uring_mailbox_flush(&p->mb);
+		else
+			queue_signal(p);
+	}
+	if (p->mode == MODE_MAILBOX)
+		io_uring_mailbox_flush(&p->mb);
+	else
+		queue_signal(p);
+	return NULL;
+}
+
+static void *receiver_fn(void *data)
+{
+	struct pair *p = data;
+	unsigned long done = 0;
+
+	pin(p->cpu + 1);
+
+	while (done < NR_MSGS) {
+		if (p->mode == MODE_MAILBOX) {
+			struct io_uring_cqe *cqe;
+			unsigned head, seen = 0;
+			int ret;
+
+			ret = io_uring_wait_cqe(&p->dst, &cqe);
+			if (ret) {
+				fprintf(stderr, "wait: %s\n", strerror(-ret));
+				exit(1);
+			}
+			io_uring_for_each_cqe(&p->dst, head, cqe) {
+				p->sum += cqe->user_data;
+				seen++;
+			}
+			io_uring_cq_advance(&p->dst, seen);
+			io_uring_mailbox_ack(&p->mb, seen);
+			done += seen;
+		} else {
+			eventfd_t val;
+
+			eventfd_read(p->efd, &val);
+			pthread_mutex_lock(&p->lock);
+			while (p->head != p->tail) {
+				p->sum += p->msgs[p->head++ % CAPACITY];
+				done++;
+			}
+			pthread_mutex_unlock(&p->lock);
+		}
+	}
+	return NULL;
+}
+
+static int setup_pair(struct pair *p, int mode, int cpu)
+{
+	struct io_uring_params params = { };
+	int ret;
+
+	memset(p, 0, sizeof(*p));
+	p->mode = mode;
+	p->cpu = cpu;
+
+	if (mode == MODE_EVENTFD) {
+		pthread_mutex_init(&p->lock, NULL);
+		p->efd = eventfd(0, 0);
+		if (p->efd < 0) {
+			perror("eventfd");
+			return 1;
+		}
+		return 0;
+	}
+
+	ret = io_uring_queue_init(QD, &p->src, 0);
+	if (ret) {
+		fprintf(stderr, "queue_init: %s\n", strerror(-ret));
+		return 1;
+	}
+	params.flags = IORING_SETUP_CQSIZE;
+	params.cq_entries = CAPACITY;
+	ret = io_uring_queue_init_params(QD, &p->dst, &params);
+	if (ret) {
+		fprintf(stderr, "queue_init: %s\n", strerror(-ret));
+		return 1;
+	}
+	ret = io_uring_mailbox_init(&p->mb, &p->src, &p->dst, 1, CAPACITY);
+	if (ret) {
+		fprintf(stderr, "mailbox_init: %s\n", strerror(-ret));
+		return 1;
+	}
+	return 0;
+}
+
+static void cleanup_pair(struct pair *p)
+{
+	if (p->mode == MODE_EVENTFD) {
+		close(p->efd);
+		pthread_mutex_destroy(&p->lock);
+		return;
+	}
+	io_uring_queue_exit(&p->src);
+	io_uring_queue_exit(&p->dst);
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(int mode, int nr_pairs)
+{
+	const unsigned long expect = NR_MSGS * (NR_MSGS + 1) / 2;
+	struct pair *pairs;
+	double start, elapsed;
+	int i, ret = 0;
+
+	pairs = calloc(nr_pairs, sizeof(*pairs));
+	for (i = 0; i < nr_pairs; i++) {
+		if (setup_pair(&pairs[i], mode, 2 * i))
+			return 1;
+	}
+
+	start = now();
+	for (i = 0; i < nr_pairs; i++) {
+		pthread_create(&pairs[i].receiver, NULL, receiver_fn, &pairs[i]);
+		pthread_create(&pairs[i].sender, NULL, sender_fn, &pairs[i]);
+	}
+	for (i = 0; i < nr_pairs; i++) {
+		pthread_join(pairs[i].sender, NULL);
+		pthread_join(pairs[i].receiver, NULL);
+	}
+	elapsed = now() - start;
+
+	for (i = 0; i < nr_pairs; i++) {
+		if (pairs[i].sum != expect) {
+			fprintf(stderr, "pair %d: lost messages\n", i);
+			ret = 1;
+		}
+		cleanup_pair(&pairs[i]);
+	}
+	free(pairs);
+
+	printf("%-8s %3d pairs: %8.0f Kmsgs/sec\n",
+		mode == MODE_MAILBOX ? "mailbox" : "eventfd", nr_pairs,
+		nr_pairs * NR_MSGS / elapsed / 1000);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_probe *probe;
+	int max_pairs = 4;
+	int i;
+
+	if (argc > 1)
+		max_pairs = atoi(argv[1]);
+	if (max_pairs < 1) {
+		printf("%s: [max sender/receiver pairs]\n", argv[0]);
+		return 1;
+	}
+	nr_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+	probe = io_uring_get_probe();
+	if (!probe || !io_uring_opcode_supported(probe, IORING_OP_MSG_RING)) {
+		printf("MSG_RING not supported\n");
+		return 1;
+	}
+	io_uring_free_probe(probe);
+
+	for (i = 1; i <= max_pairs; i *= 2) {
+		if (run(MODE_EVENTFD, i))
+			return 1;
+		if (run(MODE_MAILBOX, i))
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,187 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Compare submitting to a single ring from multiple threads through the
+ * lock-free io_uring_mpsc front-end, against the same ring protected by a
+ * mutex. Producer threads queue nops, and the main thread submits them and
+ * reaps the completions. Runs each mode with 1, 2, 4, ... up to the given
+ * number of producer threads, and prints the achieved rate.
+ *
+ * gcc -Wall -O2 -D_GNU_SOURCE -o mpsc-bench mpsc-bench.c -luring -lpthread
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "liburing.h"
+
+#define QD		256
+#define NR_OPS		1000000UL
+
+enum {
+	MODE_MUTEX,
+	MODE_MPSC,
+};
+
+struct bench {
+	struct io_uring ring;
+	struct io_uring_mpsc q;
+	pthread_mutex_t lock;
+	int mode;
+	unsigned long per_thread;
+};
+
+static struct io_uring_sqe *get_sqe(struct bench *b)
+{
+	struct io_uring_sqe *sqe;
+
+	if (b->mode == MODE_MPSC)
+		return io_uring_mpsc_get_sqe(&b->q);
+
+	pthread_mutex_lock(&b->lock);
+	sqe = io_uring_get_sqe(&b->ring);
+	if (!sqe)
+		pthread_mutex_unlock(&b->lock);
+	return sqe;
+}
+
+static void commit_sqe(struct bench *b, struct io_uring_sqe *sqe)
+{
+	if (b->mode == MODE_MPSC)
+		io_uring_mpsc_commit(&b->q, sqe);
+	else
+		pthread_mutex_unlock(&b->lock);
+}
+
+/* submit whatever the producers have queued, if anything */
+static int submit(struct bench *b)
+{
+	int ret = 0;
+
+	if (b->mode == MODE_MPSC) {
+		if (io_uring_mpsc_flush(&b->q))
+			ret = io_uring_submit(&b->ring);
+		return ret;
+	}
+
+	pthread_mutex_lock(&b->lock);
+	if (io_uring_sq_ready(&b->ring))
+		ret = io_uring_submit(&b->ring);
+	pthread_mutex_unlock(&b->lock);
+	return ret;
+}
+
+static void *producer_fn(void *data)
+{
+	struct bench *b = data;
+	struct io_uring_sqe *sqe;
+	unsigned long i;
+
+	for (i = 0; i < b->per_thread; i++) {
+		while ((sqe = get_sqe(b)) == NULL)
+			sched_yield();
+		io_uring_prep_nop(sqe);
+		commit_sqe(b, sqe);
+	}
+	return NULL;
+}
+
+static double now(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int run(int mode, int nr_threads)
+{
+	struct io_uring_params p = { };
+	unsigned long done = 0, total;
+	pthread_t *threads;
+	struct bench b;
+	double start, elapsed;
+	int i, ret;
+
+	memset(&b, 0, sizeof(b));
+	b.mode = mode;
+	b.per_thread = NR_OPS / nr_threads;
+	total = b.per_thread * nr_threads;
+	pthread_mutex_init(&b.lock, NULL);
+
+	p.flags = IORING_SETUP_CQSIZE;
+	p.cq_entries = 4 * QD;
+	ret = io_uring_queue_init_params(QD, &b.ring, &p);
+	if (ret) {
+		fprintf(stderr, "queue_init: %s\n", strerror(-ret));
+		return 1;
+	}
+	if (mode == MODE_MPSC) {
+		ret = io_uring_mpsc_init(&b.q, &b.ring);
+		if (ret) {
+			fprintf(stderr, "mpsc_init: %s\n", strerror(-ret));
+			return 1;
+		}
+	}
+
+	threads = calloc(nr_threads, sizeof(*threads));
+	start = now();
+	for (i = 0; i < nr_threads; i++)
+		pthread_create(&threads[i], NULL, producer_fn, &b);
+
+	while (done < total) {
+		struct io_uring_cqe *cqe;
+		unsigned head, seen = 0;
+
+		ret = submit(&b);
+		if (ret < 0) {
+			fprintf(stderr, "submit: %s\n", strerror(-ret));
+			return 1;
+		}
+		io_uring_for_each_cqe(&b.ring, head, cqe)
+			seen++;
+		io_uring_cq_advance(&b.ring, seen);
+		done += seen;
+		if (!ret && !seen)
+			sched_yield();
+	}
+	elapsed = now() - start;
+
+	for (i = 0; i < nr_threads; i++)
+		pthread_join(threads[i], NULL);
+	free(threads);
+
+	printf("%-6s %3d threads: %8.0f Kops/sec\n",
+		mode == MODE_MPSC ? "mpsc" : "mutex", nr_threads,
+		total / elapsed / 1000);
+
+	if (mode == MODE_MPSC)
+		io_uring_mpsc_exit(&b.q);
+	io_uring_queue_exit(&b.ring);
+	pthread_mutex_destroy(&b.lock);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int max_threads = 16;
+	int i;
+
+	if (argc > 1)
+		max_threads = atoi(argv[1]);
+	if (max_threads < 1) {
+		printf("%s: [max producer threads]\n", argv[0]);
+		return 1;
+	}
+
+	for (i = 1; i <= max_threads; i *= 2) {
+		if (run(MODE_MUTEX, i))
+			return 1;
+		if (run(MODE_MPSC, i))
+			return 1;
+	}
+
+	return 0;
+}
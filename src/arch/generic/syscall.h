@@ -77,6 +77,20 @@ static inline int __sys_setrlimit(int resource, const struct rlimit *rlim)
 	return (ret < 0) ? -errno : ret;
 }
 
+static inline int __sys_open(const char *pathname, int flags, mode_t mode)
+{
+	int ret;
+	ret = open(pathname, flags, mode);
+	return (ret < 0) ? -errno : ret;
+}
+
+static inline ssize_t __sys_read(int fd, void *buffer, size_t size)
+{
+	ssize_t ret;
+	ret = read(fd, buffer, size);
+	return (ret < 0) ? -errno : ret;
+}
+
 static inline int __sys_close(int fd)
 {
 	int ret;
@@ -17,6 +17,23 @@ static inline void *__sys_mmap(void *addr, size_t length, int prot, int flags,
 	return (void *) __do_syscall6(nr, addr, length, prot, flags, fd, offset);
 }
 
+static inline int __sys_open(const char *pathname, int flags, mode_t mode)
+{
+	/*
+	 * Some architectures don't have __NR_open, but __NR_openat.
+	 */
+#ifdef __NR_open
+	return (int) __do_syscall3(__NR_open, pathname, flags, mode);
+#else
+	return (int) __do_syscall4(__NR_openat, AT_FDCWD, pathname, flags, mode);
+#endif
+}
+
+static inline ssize_t __sys_read(int fd, void *buffer, size_t size)
+{
+	return (ssize_t) __do_syscall3(__NR_read, fd, buffer, size);
+}
+
 static inline int __sys_munmap(void *addr, size_t length)
 {
 	return (int) __do_syscall2(__NR_munmap, addr, length);
@@ -55,7 +55,10 @@ struct io_uring_sq {
 	size_t ring_sz;
 	void *ring_ptr;
 
-	unsigned pad[4];
+	unsigned submit_batch;
+	unsigned nr_submits;
+	unsigned nr_submitted;
+	unsigned max_submitted;
 };
 
 struct io_uring_cq {
@@ -70,7 +73,10 @@ struct io_uring_cq {
 	size_t ring_sz;
 	void *ring_ptr;
 
-	unsigned pad[4];
+	unsigned wait_spin;
+	unsigned spin_hits;
+	unsigned spin_misses;
+	unsigned pad;
 };
 
 struct io_uring {
@@ -86,6 +92,117 @@ struct io_uring {
 	unsigned pad2;
 };
 
+/*
+ * Outcome of spinning on the CQ ring before sleeping in the kernel, see
+ * io_uring_set_wait_spin(3)
+ */
+struct io_uring_spin_stats {
+	unsigned hits;		/* waits satisfied while spinning */
+	unsigned misses;	/* waits that went to sleep after spinning */
+};
+
+/*
+ * Batch sizes achieved by submissions, see io_uring_get_submit_stats(3)
+ */
+struct io_uring_submit_stats {
+	unsigned submits;	/* number of times new sqes were submitted */
+	unsigned sqes;		/* total number of sqes submitted */
+	unsigned max_batch;	/* largest number of sqes submitted at once */
+};
+
+/*
+ * Multi-producer submission front-end for a ring, see io_uring_mpsc_init(3).
+ * Any number of threads can get and fill sqes concurrently, while a single
+ * thread submits them.
+ */
+struct io_uring_mpsc {
+	struct io_uring *ring;
+	unsigned *ready;	/* per SQ slot, set once the sqe is filled */
+
+	/* next SQ slot to hand out, shared by producers */
+	unsigned reserved __attribute__((__aligned__(64)));
+};
+
+/*
+ * A pool of rings sharing one io-wq backend, each owned by one thread and
+ * with a backlog of queued sqes that idle rings can steal from, see
+ * io_uring_pool_init(3)
+ */
+struct io_uring_pool;
+
+struct io_uring_pool_ring {
+	struct io_uring ring;
+	struct io_uring_pool *pool;
+	struct io_uring_sqe *backlog;
+	unsigned backlog_mask;
+	unsigned index;
+	unsigned nr_stolen;	/* sqes taken from other rings' backlogs */
+
+	/* next backlog entry to take, shared with the rest of the pool */
+	unsigned head;
+	unsigned pad1[15];
+	/* next free backlog entry, only written by the owner */
+	unsigned tail;
+	unsigned chain_len;	/* linked sqes queued in the open chain */
+	unsigned pad2[14];
+};
+
+struct io_uring_pool {
+	struct io_uring_pool_ring *rings;
+	unsigned nr_rings;
+};
+
+/*
+ * Pairs the result and notification cqes of zero-copy sends, so the
+ * application knows when a buffer may be reused, see
+ * io_uring_zc_tracker_init(3)
+ */
+struct io_uring_zc_slot {
+	void *data;
+	int res;
+	unsigned state;
+};
+
+struct io_uring_zc_tracker {
+	struct io_uring_zc_slot *slots;
+	unsigned *free;		/* stack of free slot indexes */
+	unsigned nr_slots;
+	unsigned nr_free;
+	__u64 user_data_base;
+	unsigned nr_copied;	/* notifications reporting a copy */
+};
+
+/*
+ * Single producer channel passing 64-bit messages from one ring to another
+ * with IORING_OP_MSG_RING, see io_uring_mailbox_init(3)
+ */
+struct io_uring_mailbox {
+	struct io_uring *src;
+	int dst_fd;
+	unsigned id;		/* tags messages in the target cqe flags */
+	unsigned capacity;	/* max messages sent but not yet acked */
+	/* only written by the sender */
+	unsigned sent;
+	unsigned failed;	/* sends that completed with an error */
+
+	/* only written by the receiver */
+	unsigned acked __attribute__((__aligned__(64)));
+};
+
+/*
+ * Kernel capabilities, probed once per process, see io_uring_get_caps(3)
+ */
+struct io_uring_caps {
+	__u32 features;		/* IORING_FEAT_* */
+	__u32 setup_flags;	/* IORING_SETUP_* accepted by io_uring_setup(2) */
+	__u8 probed;		/* opcodes below are valid */
+	__u8 last_op;		/* last opcode known to the kernel */
+	__u8 ops_len;
+	__u8 resv;
+	__u32 resv2;
+	__u64 ops[4];		/* bitmap of supported opcodes */
+};
+
 /*
  * Library interface
  */
@@ -95,7 +212,7 @@ struct io_uring {
  * example, if it is not available). The caller is responsible for freeing it
  */
 struct io_uring_probe *io_uring_get_probe_ring(struct io_uring *ring);
-/* same as io_uring_get_probe_ring, but takes care of ring init and teardown */
+/* same as io_uring_get_probe_ring, but served from io_uring_get_caps() */
 struct io_uring_probe *io_uring_get_probe(void);
 
 /*
@@ -112,8 +229,34 @@ static inline int io_uring_opcode_supported(const struct io_uring_probe *p,
 	return (p->ops[op].flags & IO_URING_OP_SUPPORTED) != 0;
 }
 
+/*
+ * Returns the capabilities of the running kernel. They're probed on the
+ * first call, which costs a few io_uring_setup(2) calls, and later calls
+ * return the same table without entering the kernel. If io_uring is
+ * unavailable, that table is empty. If probing fails for lack of fds or
+ * memory, an empty table is returned and the next call retries.
+ */
+const struct io_uring_caps *io_uring_get_caps(void);
+
+static inline bool io_uring_caps_opcode_supported(const struct io_uring_caps *c,
+						  int op)
+{
+	if (op < 0 || op >= c->ops_len)
+		return false;
+	return (c->ops[op / 64] >> (op % 64)) & 1;
+}
+
+/* like io_uring_opcode_supported(), without needing a ring or probe */
+static inline bool io_uring_has_opcode(int op)
+{
+	return io_uring_caps_opcode_supported(io_uring_get_caps(), op);
+}
+
 int io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
 				struct io_uring_params *p);
+int io_uring_queue_init_mem(unsigned entries, struct io_uring *ring,
+				struct io_uring_params *p,
+				void *buf, size_t buf_size);
 int io_uring_queue_init(unsigned entries, struct io_uring *ring,
 			unsigned flags);
 int io_uring_queue_mmap(int fd, struct io_uring_params *p,
@@ -135,6 +278,43 @@ int io_uring_submit_and_wait_timeout(struct io_uring *ring,
 				     unsigned wait_nr,
 				     struct __kernel_timespec *ts,
 				     sigset_t *sigmask);
+int io_uring_submit_and_wait_min_timeout(struct io_uring *ring,
+					 struct io_uring_cqe **cqe_ptr,
+					 unsigned wait_nr,
+					 struct __kernel_timespec *ts,
+					 unsigned min_wait_usec,
+					 sigset_t *sigmask);
+int io_uring_get_events(struct io_uring *ring);
+int io_uring_set_wait_spin(struct io_uring *ring, unsigned nr_spins);
+void io_uring_get_wait_spin_stats(struct io_uring *ring,
+				  struct io_uring_spin_stats *stats);
+int io_uring_set_submit_batch(struct io_uring *ring, unsigned batch);
+int io_uring_mpsc_init(struct io_uring_mpsc *q, struct io_uring *ring);
+void io_uring_mpsc_exit(struct io_uring_mpsc *q);
+struct io_uring_sqe *io_uring_mpsc_get_sqe(struct io_uring_mpsc *q);
+unsigned io_uring_mpsc_flush(struct io_uring_mpsc *q);
+int io_uring_mpsc_submit(struct io_uring_mpsc *q);
+int io_uring_pool_init(struct io_uring_pool *pool, unsigned nr_rings,
+		       unsigned entries, struct io_uring_params *p);
+void io_uring_pool_exit(struct io_uring_pool *pool);
+int io_uring_pool_queue(struct io_uring_pool_ring *pr,
+			const struct io_uring_sqe *sqe);
+int io_uring_pool_submit(struct io_uring_pool_ring *pr);
+int io_uring_zc_tracker_init(struct io_uring_zc_tracker *t, unsigned nr_slots,
+			     __u64 user_data_base);
+void io_uring_zc_tracker_exit(struct io_uring_zc_tracker *t);
+int io_uring_zc_tracker_track(struct io_uring_zc_tracker *t,
+			      struct io_uring_sqe *sqe, void *data);
+int io_uring_zc_tracker_cqe(struct io_uring_zc_tracker *t,
+			    const struct io_uring_cqe *cqe, int *res,
+			    void **data);
+int io_uring_mailbox_init(struct io_uring_mailbox *mb, struct io_uring *src,
+			  struct io_uring *dst, unsigned id,
+			  unsigned capacity);
+int io_uring_mailbox_send(struct io_uring_mailbox *mb, __u64 msg);
+int io_uring_mailbox_flush(struct io_uring_mailbox *mb);
+void io_uring_get_submit_stats(struct io_uring *ring,
+			       struct io_uring_submit_stats *stats);
 
 int io_uring_register_buffers(struct io_uring *ring, const struct iovec *iovecs,
 			      unsigned nr_iovecs);
@@ -145,12 +325,18 @@ int io_uring_register_buffers_update_tag(struct io_uring *ring,
 					 unsigned off,
 					 const struct iovec *iovecs,
 					 const __u64 *tags, unsigned nr);
+int io_uring_register_buffers_sparse(struct io_uring *ring, unsigned nr);
+int io_uring_clone_buffers(struct io_uring *dst, struct io_uring *src);
+int io_uring_clone_buffers_offset(struct io_uring *dst, struct io_uring *src,
+				  unsigned dst_off, unsigned src_off,
+				  unsigned nr, unsigned flags);
 int io_uring_unregister_buffers(struct io_uring *ring);
 
 int io_uring_register_files(struct io_uring *ring, const int *files,
 			    unsigned nr_files);
 int io_uring_register_files_tags(struct io_uring *ring, const int *files,
 				 const __u64 *tags, unsigned nr);
+int io_uring_register_files_sparse(struct io_uring *ring, unsigned nr);
 int io_uring_register_files_update_tag(struct io_uring *ring, unsigned off,
 				       const int *files, const __u64 *tags,
 				       unsigned nr_files);
@@ -158,6 +344,10 @@ int io_uring_register_files_update_tag(struct io_uring *ring, unsigned off,
 int io_uring_unregister_files(struct io_uring *ring);
 int io_uring_register_files_update(struct io_uring *ring, unsigned off,
 				   int *files, unsigned nr_files);
+int io_uring_register_file_alloc_range(struct io_uring *ring,
+				       unsigned off, unsigned len);
+int io_uring_register_sync_cancel(struct io_uring *ring,
+				  struct io_uring_sync_cancel_reg *reg);
 int io_uring_register_eventfd(struct io_uring *ring, int fd);
 int io_uring_register_eventfd_async(struct io_uring *ring, int fd);
 int io_uring_unregister_eventfd(struct io_uring *ring);
@@ -177,6 +367,15 @@ int io_uring_register_iowq_max_workers(struct io_uring *ring,
 				       unsigned int *values);
 int io_uring_register_ring_fd(struct io_uring *ring);
 int io_uring_unregister_ring_fd(struct io_uring *ring);
+int io_uring_register_buf_ring(struct io_uring *ring,
+			       struct io_uring_buf_reg *reg, unsigned int flags);
+int io_uring_unregister_buf_ring(struct io_uring *ring, int bgid);
+struct io_uring_buf_ring *io_uring_setup_buf_ring(struct io_uring *ring,
+						  unsigned int nentries,
+						  int bgid, unsigned int flags,
+						  int *ret);
+int io_uring_free_buf_ring(struct io_uring *ring, struct io_uring_buf_ring *br,
+			   unsigned int nentries, int bgid);
 
 /*
  * Helper for the peek/wait single cqe functions. Exported because of that,
@@ -188,6 +387,25 @@ int __io_uring_get_cqe(struct io_uring *ring,
 
 #define LIBURING_UDATA_TIMEOUT	((__u64) -1)
 
+/*
+ * Calculates the step size for CQE iteration.
+ * 	For standard CQE's its 1, for big CQE's its two.
+ */
+#define io_uring_cqe_shift(ring)					\
+	(!!((ring)->flags & IORING_SETUP_CQE32))
+
+#define io_uring_cqe_index(ring,ptr,mask)				\
+	(((ptr) & (mask)) << io_uring_cqe_shift(ring))
+
+/*
+ * Same as above, for SQE indexing on rings set up with IORING_SETUP_SQE128.
+ */
+#define io_uring_sqe_shift(ring)					\
+	(!!((ring)->flags & IORING_SETUP_SQE128))
+
+#define io_uring_sqe_index(ring,ptr,mask)				\
+	(((ptr) & (mask)) << io_uring_sqe_shift(ring))
+
 #define io_uring_for_each_cqe(ring, head, cqe)				\
 	/*								\
 	 * io_uring_smp_load_acquire() enforces the order of tail	\
@@ -195,7 +413,8 @@ int __io_uring_get_cqe(struct io_uring *ring,
 	 */								\
 	for (head = *(ring)->cq.khead;					\
 	     (cqe = (head != io_uring_smp_load_acquire((ring)->cq.ktail) ? \
-		&(ring)->cq.cqes[head & (*(ring)->cq.kring_mask)] : NULL)); \
+		&(ring)->cq.cqes[io_uring_cqe_index(ring, head,		\
+					*(ring)->cq.kring_mask)] : NULL)); \
 	     head++)							\
 
 /*
@@ -226,6 +445,82 @@ static inline void io_uring_cqe_seen(struct io_uring *ring,
 		io_uring_cq_advance(ring, 1);
 }
 
+/* Returns true if the request 'cqe' completes selected a provided buffer. */
+static inline bool io_uring_cqe_has_buffer(const struct io_uring_cqe *cqe)
+{
+	return cqe->flags & IORING_CQE_F_BUFFER;
+}
+
+/*
+ * Returns the ID of the provided buffer used by the request 'cqe' completes,
+ * which is only valid if io_uring_cqe_has_buffer() is true.
+ */
+static inline unsigned short io_uring_cqe_buf_id(const struct io_uring_cqe *cqe)
+{
+	return cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+}
+
+/*
+ * Number of buffers a bundled recv or send completion used, for a buffer ring
+ * where every buffer is 'buf_size' bytes. They are the ring entries starting
+ * with the one holding io_uring_cqe_buf_id(), all but the last one full.
+ * Not valid for IOU_PBUF_RING_INC rings, where the first buffer may already
+ * be partially consumed and the count can't be derived from 'res'.
+ */
+static inline unsigned io_uring_cqe_bundle_count(const struct io_uring_cqe *cqe,
+						 unsigned buf_size)
+{
+	if (cqe->res <= 0 || !(cqe->flags & IORING_CQE_F_BUFFER))
+		return 0;
+	return ((unsigned) cqe->res + buf_size - 1) / buf_size;
+}
+
+/*
+ * For buffer rings set up with IOU_PBUF_RING_INC, returns true if the kernel
+ * will keep using the rest of the buffer 'cqe' consumed part of for future
+ * completions. Once this returns false for a buffer, the kernel is done with
+ * it and the application owns all of it again.
+ */
+static inline bool io_uring_cqe_buf_more(const struct io_uring_cqe *cqe)
+{
+	return cqe->flags & IORING_CQE_F_BUF_MORE;
+}
+
+/*
+ * Returns true if 'cqe', reaped from the receiving ring, is a message sent
+ * through 'mb'. The message itself is the cqe user_data.
+ */
+static inline bool io_uring_mailbox_is_msg(const struct io_uring_mailbox *mb,
+					   const struct io_uring_cqe *cqe)
+{
+	return !(cqe->flags & IORING_CQE_F_BUFFER) &&
+		(cqe->flags >> IORING_CQE_BUFFER_SHIFT) == mb->id;
+}
+
+/*
+ * Called by the sender for cqes on its own ring. Returns true if 'cqe' is a
+ * send on 'mb' that failed, with the error in cqe->res, and gives its
+ * credit back: a failed message never reaches the receiver to be acked.
+ */
+static inline bool io_uring_mailbox_failed(struct io_uring_mailbox *mb,
+					   const struct io_uring_cqe *cqe)
+{
+	if (cqe->user_data != (__u64) (uintptr_t) mb)
+		return false;
+	mb->failed++;
+	return true;
+}
+
+/*
+ * Called by the receiver once it has consumed 'nr' messages, making room
+ * for the sender to send more.
+ */
+static inline void io_uring_mailbox_ack(struct io_uring_mailbox *mb,
+					unsigned nr)
+{
+	io_uring_smp_store_release(&mb->acked, mb->acked + nr);
+}
+
 /*
  * Command prep helpers
  */
@@ -260,6 +555,24 @@ static inline __u64 io_uring_cqe_get_data64(const struct io_uring_cqe *cqe)
 	return cqe->user_data;
 }
 
+/*
+ * For rings set up with IORING_SETUP_SQE128, returns the 80 bytes of
+ * command data that start at the end of the regular sqe fields.
+ */
+static inline void *io_uring_sqe_cmd(struct io_uring_sqe *sqe)
+{
+	return sqe->cmd;
+}
+
+/*
+ * For rings set up with IORING_SETUP_CQE32, returns the 16 bytes of extra
+ * completion data that follow the regular cqe fields.
+ */
+static inline __u64 *io_uring_cqe_big(struct io_uring_cqe *cqe)
+{
+	return cqe->big_cqe;
+}
+
 /*
  * Tell the app the have the 64-bit variants of the get/set userdata
  */
@@ -274,8 +587,15 @@ static inline void io_uring_sqe_set_flags(struct io_uring_sqe *sqe,
 static inline void __io_uring_set_target_fixed_file(struct io_uring_sqe *sqe,
 						    unsigned int file_index)
 {
-	/* 0 means no fixed files, indexes should be encoded as "index + 1" */
-	sqe->file_index = file_index + 1;
+	/*
+	 * 0 means no fixed files, indexes should be encoded as "index + 1".
+	 * IORING_FILE_INDEX_ALLOC is passed through as is, asking the kernel
+	 * to pick a free slot.
+	 */
+	if (file_index == IORING_FILE_INDEX_ALLOC)
+		sqe->file_index = IORING_FILE_INDEX_ALLOC;
+	else
+		sqe->file_index = file_index + 1;
 }
 
 static inline void io_uring_prep_rw(int op, struct io_uring_sqe *sqe, int fd,
@@ -293,7 +613,8 @@ static inline void io_uring_prep_rw(int op, struct io_uring_sqe *sqe, int fd,
 	sqe->buf_index = 0;
 	sqe->personality = 0;
 	sqe->file_index = 0;
-	sqe->__pad2[0] = sqe->__pad2[1] = 0;
+	sqe->addr3 = 0;
+	sqe->__pad2[0] = 0;
 }
 
 /**
@@ -397,6 +718,94 @@ static inline void io_uring_prep_recvmsg(struct io_uring_sqe *sqe, int fd,
 	sqe->msg_flags = flags;
 }
 
+/*
+ * Multishot recvmsg, which must select a provided buffer for every message.
+ * Each buffer starts with a struct io_uring_recvmsg_out, use the
+ * io_uring_recvmsg_*() helpers to find the parts of the message in it.
+ */
+static inline void io_uring_prep_recvmsg_multishot(struct io_uring_sqe *sqe,
+						   int fd, struct msghdr *msg,
+						   unsigned flags)
+{
+	io_uring_prep_recvmsg(sqe, fd, msg, flags);
+	sqe->ioprio |= IORING_RECV_MULTISHOT;
+}
+
+/*
+ * Returns the header of a multishot recvmsg completion in 'buf' of 'buf_len'
+ * bytes (cqe->res), or NULL if the buffer is too short to hold it along with
+ * the name and control space asked for by 'msgh'.
+ */
+static inline struct io_uring_recvmsg_out *
+io_uring_recvmsg_validate(void *buf, int buf_len, struct msghdr *msgh)
+{
+	unsigned long header = msgh->msg_controllen + msgh->msg_namelen +
+				sizeof(struct io_uring_recvmsg_out);
+
+	if (buf_len < 0 || (unsigned long) buf_len < header)
+		return NULL;
+	return (struct io_uring_recvmsg_out *) buf;
+}
+
+static inline void *io_uring_recvmsg_name(struct io_uring_recvmsg_out *o)
+{
+	return (void *) &o[1];
+}
+
+static inline struct cmsghdr *
+io_uring_recvmsg_cmsg_firsthdr(struct io_uring_recvmsg_out *o,
+			       struct msghdr *msgh)
+{
+	if (o->controllen < sizeof(struct cmsghdr))
+		return NULL;
+
+	return (struct cmsghdr *)((unsigned char *) io_uring_recvmsg_name(o) +
+			msgh->msg_namelen);
+}
+
+static inline struct cmsghdr *
+io_uring_recvmsg_cmsg_nexthdr(struct io_uring_recvmsg_out *o,
+			      struct msghdr *msgh, struct cmsghdr *cmsg)
+{
+	unsigned char *end;
+
+	if (cmsg->cmsg_len < sizeof(struct cmsghdr))
+		return NULL;
+	end = (unsigned char *) io_uring_recvmsg_cmsg_firsthdr(o, msgh) +
+		o->controllen;
+	cmsg = (struct cmsghdr *)((unsigned char *) cmsg +
+			CMSG_ALIGN(cmsg->cmsg_len));
+
+	if ((unsigned char *) (cmsg + 1) > end)
+		return NULL;
+	if (((unsigned char *) cmsg) + CMSG_ALIGN(cmsg->cmsg_len) > end)
+		return NULL;
+
+	return cmsg;
+}
+
+static inline void *io_uring_recvmsg_payload(struct io_uring_recvmsg_out *o,
+					     struct msghdr *msgh)
+{
+	return (void *)((unsigned char *) io_uring_recvmsg_name(o) +
+			msgh->msg_namelen + msgh->msg_controllen);
+}
+
+/*
+ * Length of the payload that made it into the buffer, which is less than
+ * o->payloadlen for a truncated datagram received with MSG_TRUNC.
+ */
+static inline unsigned int
+io_uring_recvmsg_payload_length(struct io_uring_recvmsg_out *o,
+				int buf_len, struct msghdr *msgh)
+{
+	unsigned long payload_start, payload_end;
+
+	payload_start = (unsigned long) io_uring_recvmsg_payload(o, msgh);
+	payload_end = (unsigned long) o + buf_len;
+	return (unsigned int) (payload_end - payload_start);
+}
+
 static inline void io_uring_prep_sendmsg(struct io_uring_sqe *sqe, int fd,
 					 const struct msghdr *msg,
 					 unsigned flags)
@@ -502,6 +911,29 @@ static inline void io_uring_prep_accept_direct(struct io_uring_sqe *sqe, int fd,
 	__io_uring_set_target_fixed_file(sqe, file_index);
 }
 
+/*
+ * Keep accepting connections on 'fd' with a single sqe, posting one cqe per
+ * connection until the request is cancelled or hits an error.
+ */
+static inline void io_uring_prep_multishot_accept(struct io_uring_sqe *sqe,
+						  int fd, struct sockaddr *addr,
+						  socklen_t *addrlen, int flags)
+{
+	io_uring_prep_accept(sqe, fd, addr, addrlen, flags);
+	sqe->ioprio |= IORING_ACCEPT_MULTISHOT;
+}
+
+/* multishot accept directly into the fixed file table, in kernel picked slots */
+static inline void io_uring_prep_multishot_accept_direct(struct io_uring_sqe *sqe,
+							 int fd,
+							 struct sockaddr *addr,
+							 socklen_t *addrlen,
+							 int flags)
+{
+	io_uring_prep_multishot_accept(sqe, fd, addr, addrlen, flags);
+	__io_uring_set_target_fixed_file(sqe, IORING_FILE_INDEX_ALLOC);
+}
+
 static inline void io_uring_prep_cancel(struct io_uring_sqe *sqe,
 					__u64 user_data, int flags)
 {
@@ -510,6 +942,18 @@ static inline void io_uring_prep_cancel(struct io_uring_sqe *sqe,
 	sqe->cancel_flags = (__u32) flags;
 }
 
+/*
+ * Cancel requests issued against 'fd', rather than by user_data. Pass
+ * IORING_ASYNC_CANCEL_ALL in 'flags' to cancel all of them in one go, and
+ * IORING_ASYNC_CANCEL_FD_FIXED if 'fd' is a fixed file index.
+ */
+static inline void io_uring_prep_cancel_fd(struct io_uring_sqe *sqe, int fd,
+					   unsigned int flags)
+{
+	io_uring_prep_rw(IORING_OP_ASYNC_CANCEL, sqe, fd, NULL, 0, 0);
+	sqe->cancel_flags = (__u32) flags | IORING_ASYNC_CANCEL_FD;
+}
+
 static inline void io_uring_prep_link_timeout(struct io_uring_sqe *sqe,
 					      struct __kernel_timespec *ts,
 					      unsigned flags)
@@ -617,6 +1061,50 @@ static inline void io_uring_prep_send(struct io_uring_sqe *sqe, int sockfd,
 	sqe->msg_flags = (__u32) flags;
 }
 
+/*
+ * Zero-copy sends post their result cqe with IORING_CQE_F_MORE set, and a
+ * second IORING_CQE_F_NOTIF cqe with the same user_data once the kernel no
+ * longer references the buffer. See io_uring_zc_tracker_init(3) for pairing
+ * the two.
+ */
+static inline void io_uring_prep_send_zc(struct io_uring_sqe *sqe, int sockfd,
+					 const void *buf, size_t len, int flags,
+					 unsigned zc_flags)
+{
+	io_uring_prep_rw(IORING_OP_SEND_ZC, sqe, sockfd, buf, (__u32) len, 0);
+	sqe->msg_flags = (__u32) flags;
+	sqe->ioprio = zc_flags;
+}
+
+/* zero-copy send from the registered buffer at 'buf_index' */
+static inline void io_uring_prep_send_zc_fixed(struct io_uring_sqe *sqe,
+					       int sockfd, const void *buf,
+					       size_t len, int flags,
+					       unsigned zc_flags,
+					       unsigned buf_index)
+{
+	io_uring_prep_send_zc(sqe, sockfd, buf, len, flags, zc_flags);
+	sqe->ioprio |= IORING_RECVSEND_FIXED_BUF;
+	sqe->buf_index = buf_index;
+}
+
+static inline void io_uring_prep_sendmsg_zc(struct io_uring_sqe *sqe, int fd,
+					    const struct msghdr *msg,
+					    unsigned flags)
+{
+	io_uring_prep_sendmsg(sqe, fd, msg, flags);
+	sqe->opcode = IORING_OP_SENDMSG_ZC;
+}
+
+/* destination address for a send_zc on an unconnected socket */
+static inline void io_uring_prep_send_set_addr(struct io_uring_sqe *sqe,
+					       const struct sockaddr *dest_addr,
+					       __u16 addr_len)
+{
+	sqe->addr2 = (unsigned long)(const void *) dest_addr;
+	sqe->addr_len = addr_len;
+}
+
 static inline void io_uring_prep_recv(struct io_uring_sqe *sqe, int sockfd,
 				      void *buf, size_t len, int flags)
 {
@@ -624,6 +1112,46 @@ static inline void io_uring_prep_recv(struct io_uring_sqe *sqe, int sockfd,
 	sqe->msg_flags = (__u32) flags;
 }
 
+/*
+ * Bundled recv, filling as many consecutive buffers of buffer ring 'bgid' as
+ * the data available needs. Can be combined with IORING_RECV_MULTISHOT.
+ */
+static inline void io_uring_prep_recv_bundle(struct io_uring_sqe *sqe,
+					     int sockfd, unsigned short bgid,
+					     int flags)
+{
+	io_uring_prep_recv(sqe, sockfd, NULL, 0, flags);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bgid;
+	sqe->ioprio |= IORING_RECVSEND_BUNDLE;
+}
+
+/*
+ * Bundled send, draining the buffers queued in buffer ring 'bgid' as one
+ * send.
+ */
+static inline void io_uring_prep_send_bundle(struct io_uring_sqe *sqe,
+					     int sockfd, unsigned short bgid,
+					     int flags)
+{
+	io_uring_prep_send(sqe, sockfd, NULL, 0, flags);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = bgid;
+	sqe->ioprio |= IORING_RECVSEND_BUNDLE;
+}
+
+/*
+ * Multishot recv, posting a cqe for every chunk of data received into a
+ * newly selected provided buffer, until the request terminates.
+ */
+static inline void io_uring_prep_recv_multishot(struct io_uring_sqe *sqe,
+						int sockfd, void *buf,
+						size_t len, int flags)
+{
+	io_uring_prep_recv(sqe, sockfd, buf, len, flags);
+	sqe->ioprio |= IORING_RECV_MULTISHOT;
+}
+
 static inline void io_uring_prep_openat2(struct io_uring_sqe *sqe, int dfd,
 					const char *path, struct open_how *how)
 {
@@ -725,9 +1253,85 @@ static inline void io_uring_prep_msg_ring(struct io_uring_sqe *sqe, int fd,
 					  unsigned int flags)
 {
 	io_uring_prep_rw(IORING_OP_MSG_RING, sqe, fd, NULL, len, data);
+	sqe->msg_ring_flags = flags;
+}
+
+/* like io_uring_prep_msg_ring(), but also sets the flags of the target cqe */
+static inline void io_uring_prep_msg_ring_cqe_flags(struct io_uring_sqe *sqe,
+						    int fd, unsigned int len,
+						    __u64 data,
+						    unsigned int flags,
+						    unsigned int cqe_flags)
+{
+	io_uring_prep_rw(IORING_OP_MSG_RING, sqe, fd, NULL, len, data);
+	sqe->msg_ring_flags = IORING_MSG_RING_FLAGS_PASS | flags;
+	sqe->file_index = cqe_flags;
+}
+
+static inline void io_uring_prep_socket(struct io_uring_sqe *sqe, int domain,
+					int type, int protocol,
+					unsigned int flags)
+{
+	io_uring_prep_rw(IORING_OP_SOCKET, sqe, domain, NULL, protocol, type);
 	sqe->rw_flags = flags;
 }
 
+/*
+ * Create the socket straight into slot 'file_index' of the fixed file table,
+ * or a slot picked by the kernel if it's IORING_FILE_INDEX_ALLOC.
+ */
+static inline void io_uring_prep_socket_direct(struct io_uring_sqe *sqe,
+					       int domain, int type,
+					       int protocol,
+					       unsigned file_index,
+					       unsigned int flags)
+{
+	io_uring_prep_socket(sqe, domain, type, protocol, flags);
+	__io_uring_set_target_fixed_file(sqe, file_index);
+}
+
+static inline void io_uring_prep_socket_direct_alloc(struct io_uring_sqe *sqe,
+						     int domain, int type,
+						     int protocol,
+						     unsigned int flags)
+{
+	io_uring_prep_socket_direct(sqe, domain, type, protocol,
+				    IORING_FILE_INDEX_ALLOC, flags);
+}
+
+/*
+ * Socket command 'cmd_op' (SOCKET_URING_OP_*) on 'fd'. For the sockopt
+ * commands, 'level', 'optname', 'optval' and 'optlen' are as for
+ * getsockopt(2) and setsockopt(2), and getsockopt posts the resulting
+ * optlen in cqe->res.
+ */
+static inline void io_uring_prep_cmd_sock(struct io_uring_sqe *sqe,
+					  int cmd_op, int fd, int level,
+					  int optname, void *optval,
+					  int optlen)
+{
+	io_uring_prep_rw(IORING_OP_URING_CMD, sqe, fd, NULL, 0, 0);
+	sqe->optval = (unsigned long) (uintptr_t) optval;
+	sqe->optname = (__u32) optname;
+	sqe->optlen = (__u32) optlen;
+	sqe->cmd_op = (__u32) cmd_op;
+	sqe->level = (__u32) level;
+}
+
+static inline void io_uring_prep_bind(struct io_uring_sqe *sqe, int fd,
+				      const struct sockaddr *addr,
+				      socklen_t addrlen)
+{
+	io_uring_prep_rw(IORING_OP_BIND, sqe, fd, addr, 0, addrlen);
+}
+
+static inline void io_uring_prep_listen(struct io_uring_sqe *sqe, int fd,
+					int backlog)
+{
+	io_uring_prep_rw(IORING_OP_LISTEN, sqe, fd, NULL, (unsigned) backlog,
+			 0);
+}
+
 /*
  * Returns number of unconsumed (if SQPOLL) or unsubmitted entries exist in
  * the SQ ring
@@ -844,6 +1448,7 @@ static inline int __io_uring_peek_cqe(struct io_uring *ring,
 	int err = 0;
 	unsigned available;
 	unsigned mask = *ring->cq.kring_mask;
+	int shift = io_uring_cqe_shift(ring);
 
 	do {
 		unsigned tail = io_uring_smp_load_acquire(ring->cq.ktail);
@@ -854,7 +1459,7 @@ static inline int __io_uring_peek_cqe(struct io_uring *ring,
 		if (!available)
 			break;
 
-		cqe = &ring->cq.cqes[head & mask];
+		cqe = &ring->cq.cqes[(head & mask) << shift];
 		if (!(ring->features & IORING_FEAT_EXT_ARG) &&
 				cqe->user_data == LIBURING_UDATA_TIMEOUT) {
 			if (cqe->res < 0)
@@ -894,12 +1499,38 @@ static inline int io_uring_peek_cqe(struct io_uring *ring,
 static inline int io_uring_wait_cqe(struct io_uring *ring,
 				    struct io_uring_cqe **cqe_ptr)
 {
-	if (!__io_uring_peek_cqe(ring, cqe_ptr, NULL) && *cqe_ptr)
+	/*
+	 * With auto-submit batching, waits submit what's queued up, so only
+	 * take the shortcut if there's nothing to submit.
+	 */
+	if ((!ring->sq.submit_batch || ring->sq.sqe_tail == ring->sq.sqe_head) &&
+	    !__io_uring_peek_cqe(ring, cqe_ptr, NULL) && *cqe_ptr)
 		return 0;
 
 	return io_uring_wait_cqe_nr(ring, cqe_ptr, 1);
 }
 
+/*
+ * Internal helper, don't use directly in applications. If an auto-submit
+ * batch size has been set with io_uring_set_submit_batch() and that many
+ * sqes are queued up, submit them before handing out more. Holds off while
+ * the newest sqe links to the next one, as submitting would split the chain.
+ */
+static inline void __io_uring_auto_submit(struct io_uring *ring)
+{
+	struct io_uring_sq *sq = &ring->sq;
+	struct io_uring_sqe *last;
+
+	if (uring_likely(!sq->submit_batch) ||
+	    sq->sqe_tail - sq->sqe_head < sq->submit_batch)
+		return;
+	last = &sq->sqes[io_uring_sqe_index(ring, sq->sqe_tail - 1,
+					    *sq->kring_mask)];
+	if (last->flags & (IOSQE_IO_LINK | IOSQE_IO_HARDLINK))
+		return;
+	io_uring_submit(ring);
+}
+
 /*
  * Return an sqe to fill. Application must later call io_uring_submit()
  * when it's ready to tell the kernel about it. The caller may call this
@@ -910,17 +1541,132 @@ static inline int io_uring_wait_cqe(struct io_uring *ring,
 static inline struct io_uring_sqe *_io_uring_get_sqe(struct io_uring *ring)
 {
 	struct io_uring_sq *sq = &ring->sq;
-	unsigned int head = io_uring_smp_load_acquire(sq->khead);
-	unsigned int next = sq->sqe_tail + 1;
+	unsigned int head, next;
 	struct io_uring_sqe *sqe = NULL;
 
+	__io_uring_auto_submit(ring);
+	head = io_uring_smp_load_acquire(sq->khead);
+	next = sq->sqe_tail + 1;
+
 	if (next - head <= *sq->kring_entries) {
-		sqe = &sq->sqes[sq->sqe_tail & *sq->kring_mask];
+		sqe = &sq->sqes[io_uring_sqe_index(ring, sq->sqe_tail,
+						   *sq->kring_mask)];
 		sq->sqe_tail = next;
 	}
 	return sqe;
 }
 
+/*
+ * Like io_uring_get_sqe(), but reserves 'nr' sqes in one go, loading the
+ * kernel SQ head only once. The run of sqes may wrap around the end of the
+ * SQ ring, so they are returned as an array of pointers in 'sqes'. The
+ * reserved entries are published together by the next io_uring_submit()
+ * or variant thereof.
+ *
+ * Returns 'nr' on success, or 0 if the SQ ring doesn't have room for all of
+ * them. In the latter case, no sqes are reserved.
+ */
+static inline unsigned io_uring_get_sqes(struct io_uring *ring,
+					 struct io_uring_sqe **sqes,
+					 unsigned nr)
+{
+	struct io_uring_sq *sq = &ring->sq;
+	unsigned int head, tail;
+	unsigned int mask = *sq->kring_mask;
+	unsigned int i;
+
+	__io_uring_auto_submit(ring);
+	head = io_uring_smp_load_acquire(sq->khead);
+	tail = sq->sqe_tail;
+
+	if (tail + nr - head > *sq->kring_entries)
+		return 0;
+
+	for (i = 0; i < nr; i++)
+		sqes[i] = &sq->sqes[io_uring_sqe_index(ring, tail + i, mask)];
+	sq->sqe_tail = tail + nr;
+	return nr;
+}
+
+/*
+ * Return the appropriate mask for a buffer ring of size 'ring_entries'
+ */
+static inline int io_uring_buf_ring_mask(__u32 ring_entries)
+{
+	return ring_entries - 1;
+}
+
+static inline void io_uring_buf_ring_init(struct io_uring_buf_ring *br)
+{
+	br->tail = 0;
+}
+
+/*
+ * Assign 'buf' with the addr/len/buffer ID supplied. The buffer isn't
+ * visible to the kernel until io_uring_buf_ring_advance() is called.
+ */
+static inline void io_uring_buf_ring_add(struct io_uring_buf_ring *br,
+					 void *addr, unsigned int len,
+					 unsigned short bid, int mask,
+					 int buf_offset)
+{
+	struct io_uring_buf *buf = &br->bufs[(br->tail + buf_offset) & mask];
+
+	buf->addr = (unsigned long) (uintptr_t) addr;
+	buf->len = len;
+	buf->bid = bid;
+}
+
+/*
+ * Make 'count' new buffers visible to the kernel. Called after
+ * io_uring_buf_ring_add() has been called 'count' times to fill in new
+ * buffers.
+ */
+static inline void io_uring_buf_ring_advance(struct io_uring_buf_ring *br,
+					     int count)
+{
+	unsigned short new_tail = br->tail + count;
+
+	io_uring_smp_store_release(&br->tail, new_tail);
+}
+
+static inline void __io_uring_buf_ring_cq_advance(struct io_uring *ring,
+						  struct io_uring_buf_ring *br,
+						  int cq_count, int buf_count)
+{
+	io_uring_buf_ring_advance(br, buf_count);
+	io_uring_cq_advance(ring, cq_count);
+}
+
+/*
+ * Make 'count' new buffers visible to the kernel while at the same time
+ * advancing the CQ ring seen entries. This can be used when the application
+ * is using ring provided buffers and returns buffers while processing CQEs,
+ * avoiding an extra atomic when needing to increment both the CQ ring and
+ * the ring buffer index at the same time.
+ */
+static inline void io_uring_buf_ring_cq_advance(struct io_uring *ring,
+						struct io_uring_buf_ring *br,
+						int count)
+{
+	__io_uring_buf_ring_cq_advance(ring, br, count, count);
+}
+
+/*
+ * Mark an sqe returned by io_uring_mpsc_get_sqe() as filled in, making it
+ * eligible for submission by io_uring_mpsc_flush(). The sqe must not be
+ * touched afterwards.
+ */
+static inline void io_uring_mpsc_commit(struct io_uring_mpsc *q,
+					struct io_uring_sqe *sqe)
+{
+	struct io_uring *ring = q->ring;
+	unsigned index = (sqe - ring->sq.sqes) >> io_uring_sqe_shift(ring);
+
+	/* pairs with the acquire in io_uring_mpsc_flush() */
+	io_uring_smp_store_release(&q->ready[index], 1U);
+}
+
 #ifndef LIBURING_INTERNAL
 static inline struct io_uring_sqe *io_uring_get_sqe(struct io_uring *ring)
 {
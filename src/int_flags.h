@@ -4,6 +4,7 @@
 
 enum {
 	INT_FLAG_REG_RING	= 1,
+	INT_FLAG_APP_MEM	= 2,
 };
 
 #endif
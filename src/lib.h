@@ -9,6 +9,8 @@
 #define __INTERNAL__LIBURING_LIB_H
 #if defined(__x86_64__) || defined(__i386__)
 	#include "arch/x86/lib.h"
+#elif defined(__aarch64__)
+	#include "arch/aarch64/lib.h"
 #else
 	/*
 	 * We don't have nolibc support for this arch. Must use libc!
@@ -33,6 +35,17 @@
 	})
 #endif
 
+static inline void cpu_relax(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_ia32_pause();
+#elif defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
 void *__uring_malloc(size_t len);
 void __uring_free(void *p);
 
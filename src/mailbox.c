@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: MIT */
+#define _DEFAULT_SOURCE
+
+#include "lib.h"
+#include "liburing.h"
+#include "liburing/compat.h"
+#include "liburing/io_uring.h"
+
+/*
+ * Messages are tagged with 'id' in the upper 16 bits of the target cqe
+ * flags, which the kernel only uses for buffer IDs when IORING_CQE_F_BUFFER
+ * is set. 'capacity' bounds the messages in flight, and should leave room in
+ * the target CQ ring for its other completions.
+ */
+int io_uring_mailbox_init(struct io_uring_mailbox *mb, struct io_uring *src,
+			  struct io_uring *dst, unsigned id,
+			  unsigned capacity)
+{
+	if (!id || id > 0xffff)
+		return -EINVAL;
+	if (!capacity || capacity > *dst->cq.kring_entries)
+		return -EINVAL;
+
+	memset(mb, 0, sizeof(*mb));
+	mb->src = src;
+	mb->dst_fd = dst->ring_fd;
+	mb->id = id;
+	mb->capacity = capacity;
+	return 0;
+}
+
+/*
+ * Queue 'msg' on the sending ring. Messages are batched in the SQ ring until
+ * io_uring_mailbox_flush() or another submit on that ring. Returns -EAGAIN
+ * if the receiver has 'capacity' messages it hasn't acked yet.
+ */
+int io_uring_mailbox_send(struct io_uring_mailbox *mb, __u64 msg)
+{
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	if (mb->sent - mb->failed - io_uring_smp_load_acquire(&mb->acked) >=
+	    mb->capacity)
+		return -EAGAIN;
+
+	sqe = io_uring_get_sqe(mb->src);
+	if (!sqe) {
+		ret = io_uring_submit(mb->src);
+		if (ret < 0)
+			return ret;
+		sqe = io_uring_get_sqe(mb->src);
+		if (!sqe)
+			return -EBUSY;
+	}
+
+	io_uring_prep_msg_ring_cqe_flags(sqe, mb->dst_fd, 0, msg, 0,
+					 mb->id << IORING_CQE_BUFFER_SHIFT);
+	/*
+	 * Only failures post a cqe on the sending ring, tagged with the
+	 * mailbox so io_uring_mailbox_failed() can take the credit back.
+	 */
+	sqe->flags |= IOSQE_CQE_SKIP_SUCCESS;
+	io_uring_sqe_set_data(sqe, mb);
+	mb->sent++;
+	return 0;
+}
+
+int io_uring_mailbox_flush(struct io_uring_mailbox *mb)
+{
+	return io_uring_submit(mb->src);
+}
@@ -4,6 +4,8 @@
 #error "This file should only be compiled for no libc build"
 #endif
 
+#include <stdatomic.h>
+
 #include "lib.h"
 #include "syscall.h"
 
@@ -18,21 +20,118 @@ void *memset(void *s, int c, size_t n)
 	return s;
 }
 
+/*
+ * Allocations of up to a page come from per size class slabs, carved out of
+ * larger chunks and recycled through a free list per class, so only growing
+ * a class makes a syscall. Chunks are never handed back to the kernel.
+ * Anything bigger gets a mapping of its own, as it would span whole pages
+ * anyway. Either way, 'len' is the size of the block the header sits in,
+ * which tells the two apart on free.
+ */
 struct uring_heap {
 	size_t		len;
 	char		user_p[] __attribute__((__aligned__));
 };
 
+#define SLAB_MIN_SHIFT		5
+#define SLAB_MAX_SHIFT		12
+#define SLAB_NR_CLASSES		(SLAB_MAX_SHIFT - SLAB_MIN_SHIFT + 1)
+#define SLAB_CHUNK_SIZE		(64 * 1024)
+
+struct uring_slab_free {
+	struct uring_slab_free	*next;
+};
+
+struct uring_slab {
+	struct uring_slab_free	*free;
+	/* part of the last chunk that hasn't been handed out yet */
+	char			*next;
+	char			*end;
+};
+
+static struct uring_slab slabs[SLAB_NR_CLASSES];
+static atomic_flag slab_lock = ATOMIC_FLAG_INIT;
+
+static void slab_lock_acquire(void)
+{
+	while (atomic_flag_test_and_set_explicit(&slab_lock,
+						 memory_order_acquire))
+		;
+}
+
+static void slab_lock_release(void)
+{
+	atomic_flag_clear_explicit(&slab_lock, memory_order_release);
+}
+
+static unsigned slab_class(size_t size)
+{
+	unsigned shift = SLAB_MIN_SHIFT;
+
+	while ((1UL << shift) < size)
+		shift++;
+	return shift - SLAB_MIN_SHIFT;
+}
+
+static struct uring_heap *slab_alloc(unsigned cls)
+{
+	struct uring_slab *slab = &slabs[cls];
+	size_t size = 1UL << (cls + SLAB_MIN_SHIFT);
+	struct uring_heap *heap;
+	char *chunk;
+
+	slab_lock_acquire();
+	if (slab->free) {
+		heap = (struct uring_heap *) slab->free;
+		slab->free = slab->free->next;
+	} else {
+		if (slab->next == slab->end) {
+			chunk = __sys_mmap(NULL, SLAB_CHUNK_SIZE,
+					   PROT_READ | PROT_WRITE,
+					   MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+			if (IS_ERR(chunk)) {
+				slab_lock_release();
+				return NULL;
+			}
+			slab->next = chunk;
+			slab->end = chunk + SLAB_CHUNK_SIZE;
+		}
+		heap = (struct uring_heap *) slab->next;
+		slab->next += size;
+	}
+	slab_lock_release();
+
+	heap->len = size;
+	return heap;
+}
+
+static void slab_free(struct uring_heap *heap)
+{
+	struct uring_slab *slab = &slabs[slab_class(heap->len)];
+	struct uring_slab_free *f = (struct uring_slab_free *) heap;
+
+	slab_lock_acquire();
+	f->next = slab->free;
+	slab->free = f;
+	slab_lock_release();
+}
+
 void *__uring_malloc(size_t len)
 {
 	struct uring_heap *heap;
+	size_t size = sizeof(*heap) + len;
+
+	if (size <= (1UL << SLAB_MAX_SHIFT)) {
+		heap = slab_alloc(slab_class(size));
+		return heap ? heap->user_p : NULL;
+	}
 
-	heap = __sys_mmap(NULL, sizeof(*heap) + len, PROT_READ | PROT_WRITE,
+	heap = __sys_mmap(NULL, size, PROT_READ | PROT_WRITE,
 			  MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
 	if (IS_ERR(heap))
 		return NULL;
 
-	heap->len = sizeof(*heap) + len;
+	heap->len = size;
 	return heap->user_p;
 }
 
@@ -44,5 +143,8 @@ void __uring_free(void *p)
 		return;
 
 	heap = container_of(p, struct uring_heap, user_p);
-	__sys_munmap(heap, heap->len);
+	if (heap->len <= (1UL << SLAB_MAX_SHIFT))
+		slab_free(heap);
+	else
+		__sys_munmap(heap, heap->len);
 }
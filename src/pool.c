@@ -0,0 +1,203 @@
+/* SPDX-License-Identifier: MIT */
+#define _DEFAULT_SOURCE
+
+#include "lib.h"
+#include "syscall.h"
+#include "liburing.h"
+#include "liburing/compat.h"
+#include "liburing/io_uring.h"
+
+#define LINK_FLAGS	(IOSQE_IO_LINK | IOSQE_IO_HARDLINK)
+
+/*
+ * Each ring in a pool has a backlog of sqes that have been queued, but not
+ * yet moved to its SQ ring. The owner adds to the tail, and both the owner
+ * and peers looking for work take from the head, which makes taking work
+ * the only operation that needs to be atomic.
+ *
+ * Take the sqe at the head of the backlog of 'from', along with the rest of
+ * its chain if it's linked, and move them to the SQ ring of 'pr'. Chains
+ * are only ever taken whole, so nothing is taken if the chain is longer
+ * than 'max', or if its owner hasn't queued the sqe ending it yet. Returns
+ * the number of sqes taken.
+ */
+static unsigned backlog_take(struct io_uring_pool_ring *pr,
+			     struct io_uring_pool_ring *from, unsigned max)
+{
+	_Atomic unsigned *head = (_Atomic unsigned *) &from->head;
+	struct io_uring_sq *sq = &pr->ring.sq;
+	struct io_uring_sqe *sqe;
+	unsigned h, t, nr;
+
+	h = atomic_load_explicit(head, memory_order_acquire);
+	do {
+		t = io_uring_smp_load_acquire(&from->tail);
+		nr = 0;
+		do {
+			if (h + nr == t || nr == max)
+				return 0;
+			/*
+			 * Space was checked by the caller, and the SQ slots
+			 * aren't handed out until the head has moved. The
+			 * owner can't reuse backlog entries until then either,
+			 * so if we manage to move it, the copies are intact.
+			 */
+			sqe = &sq->sqes[io_uring_sqe_index(&pr->ring,
+						sq->sqe_tail + nr,
+						*sq->kring_mask)];
+			*sqe = from->backlog[(h + nr) & from->backlog_mask];
+			nr++;
+		} while (sqe->flags & LINK_FLAGS);
+	} while (!atomic_compare_exchange_weak_explicit(head, &h, h + nr,
+							memory_order_acq_rel,
+							memory_order_acquire));
+
+	sq->sqe_tail += nr;
+	return nr;
+}
+
+static unsigned backlog_pending(struct io_uring_pool_ring *pr)
+{
+	return io_uring_smp_load_acquire(&pr->tail) -
+		io_uring_smp_load_acquire(&pr->head);
+}
+
+/*
+ * Move up to 'max' sqes from the backlog of 'from' to the SQ ring of 'pr',
+ * stopping at the first chain that doesn't fit. Returns the number moved.
+ */
+static unsigned pool_move(struct io_uring_pool_ring *pr,
+			  struct io_uring_pool_ring *from, unsigned max)
+{
+	unsigned nr = 0, taken;
+
+	while (nr < max && (taken = backlog_take(pr, from, max - nr)))
+		nr += taken;
+	return nr;
+}
+
+/*
+ * Set up a pool of 'nr_rings' rings of 'entries' each, using 'p' as the
+ * setup parameters for all of them. All but the first ring are attached to
+ * the io-wq backend of the first, so async work from any of them is served
+ * by one set of workers. Returns 0 on success, -errno on failure.
+ */
+int io_uring_pool_init(struct io_uring_pool *pool, unsigned nr_rings,
+		       unsigned entries, struct io_uring_params *p)
+{
+	size_t len;
+	unsigned i;
+	int ret;
+
+	if (!nr_rings || (p->flags & (IORING_SETUP_SQE128 |
+				      IORING_SETUP_ATTACH_WQ)))
+		return -EINVAL;
+
+	len = nr_rings * sizeof(*pool->rings);
+	pool->rings = uring_malloc(len);
+	if (!pool->rings)
+		return -ENOMEM;
+	memset(pool->rings, 0, len);
+	pool->nr_rings = 0;
+
+	for (i = 0; i < nr_rings; i++) {
+		struct io_uring_pool_ring *pr = &pool->rings[i];
+		struct io_uring_params lp = *p;
+		unsigned backlog;
+
+		if (i) {
+			lp.flags |= IORING_SETUP_ATTACH_WQ;
+			lp.wq_fd = pool->rings[0].ring.ring_fd;
+		}
+		ret = io_uring_queue_init_params(entries, &pr->ring, &lp);
+		if (ret)
+			goto err;
+
+		backlog = 2 * *pr->ring.sq.kring_entries;
+		pr->backlog = uring_malloc(backlog * sizeof(*pr->backlog));
+		if (!pr->backlog) {
+			io_uring_queue_exit(&pr->ring);
+			ret = -ENOMEM;
+			goto err;
+		}
+		pr->backlog_mask = backlog - 1;
+		pr->pool = pool;
+		pr->index = i;
+		pool->nr_rings++;
+	}
+
+	return 0;
+err:
+	io_uring_pool_exit(pool);
+	return ret;
+}
+
+void io_uring_pool_exit(struct io_uring_pool *pool)
+{
+	unsigned i;
+
+	for (i = 0; i < pool->nr_rings; i++) {
+		uring_free(pool->rings[i].backlog);
+		io_uring_queue_exit(&pool->rings[i].ring);
+	}
+	uring_free(pool->rings);
+	pool->rings = NULL;
+	pool->nr_rings = 0;
+}
+
+/*
+ * Queue a copy of 'sqe' to the backlog of 'pr'. It gets submitted by the
+ * next io_uring_pool_submit() on 'pr', unless an idle ring in the pool
+ * steals it first. Must only be called by the thread owning 'pr'. Returns
+ * 0 on success, -EBUSY if the backlog is full, or -EINVAL if 'sqe' would
+ * make a chain of linked sqes longer than the SQ ring, which could never be
+ * moved to it.
+ */
+int io_uring_pool_queue(struct io_uring_pool_ring *pr,
+			const struct io_uring_sqe *sqe)
+{
+	unsigned tail = pr->tail;
+
+	if (tail - io_uring_smp_load_acquire(&pr->head) > pr->backlog_mask)
+		return -EBUSY;
+	if (pr->chain_len >= *pr->ring.sq.kring_entries)
+		return -EINVAL;
+
+	pr->backlog[tail & pr->backlog_mask] = *sqe;
+	pr->chain_len = sqe->flags & LINK_FLAGS ? pr->chain_len + 1 : 0;
+	/* pairs with the acquire in backlog_take() */
+	io_uring_smp_store_release(&pr->tail, tail + 1);
+	return 0;
+}
+
+/*
+ * Move as much of the backlog of 'pr' to its SQ ring as fits. If there's
+ * room left after that, steal up to half of the backlog of other rings in
+ * the pool, starting with the one after 'pr'. Then submit. Completions for
+ * stolen work are posted to 'pr', as that's the ring that issued it. Must
+ * only be called by the thread owning 'pr'. Returns the number of sqes
+ * submitted, or -errno.
+ */
+int io_uring_pool_submit(struct io_uring_pool_ring *pr)
+{
+	struct io_uring_pool *pool = pr->pool;
+	unsigned space, i;
+
+	space = io_uring_sq_space_left(&pr->ring);
+	space -= pool_move(pr, pr, space);
+
+	for (i = 1; space && i < pool->nr_rings; i++) {
+		struct io_uring_pool_ring *peer;
+		unsigned nr;
+
+		peer = &pool->rings[(pr->index + i) % pool->nr_rings];
+		nr = (backlog_pending(peer) + 1) / 2;
+		if (!nr)
+			continue;
+		nr = pool_move(pr, peer, nr < space ? nr : space);
+		pr->nr_stolen += nr;
+		space -= nr;
+	}
+
+	return io_uring_submit(&pr->ring);
+}
@@ -33,20 +33,88 @@ static inline bool sq_ring_needs_enter(struct io_uring *ring, unsigned *flags)
 	return false;
 }
 
+/*
+ * Returns true if the CQ ring has overflowed completions that need flushing,
+ * or if the kernel flagged pending task work (IORING_SETUP_TASKRUN_FLAG)
+ * that needs a kernel transition to post its completions.
+ */
 static inline bool cq_ring_needs_flush(struct io_uring *ring)
 {
-	return IO_URING_READ_ONCE(*ring->sq.kflags) & IORING_SQ_CQ_OVERFLOW;
+	return IO_URING_READ_ONCE(*ring->sq.kflags) &
+				(IORING_SQ_CQ_OVERFLOW | IORING_SQ_TASKRUN);
 }
 
+/*
+ * With IORING_SETUP_DEFER_TASKRUN, completions may be sitting in the task's
+ * deferred work list, and they will only get posted to the CQ ring when we
+ * enter the kernel asking for events. If the ring was also set up with
+ * IORING_SETUP_TASKRUN_FLAG, the kernel tells us when that is the case and
+ * we can skip the system call if nothing is pending.
+ */
 static inline bool cq_ring_needs_enter(struct io_uring *ring)
 {
-	return (ring->flags & IORING_SETUP_IOPOLL) || cq_ring_needs_flush(ring);
+	if (ring->flags & IORING_SETUP_IOPOLL)
+		return true;
+	if ((ring->flags & (IORING_SETUP_DEFER_TASKRUN |
+			    IORING_SETUP_TASKRUN_FLAG)) ==
+	    IORING_SETUP_DEFER_TASKRUN)
+		return true;
+	return cq_ring_needs_flush(ring);
+}
+
+/*
+ * Returns true if completions can show up in the CQ ring without us entering
+ * the kernel, which is what makes spinning on it worthwhile. With IOPOLL, the
+ * polling is done on entering (unless SQPOLL does it for us), and with
+ * DEFER_TASKRUN or COOP_TASKRUN the completion task work only runs once we
+ * transition to the kernel. The latter is fine with TASKRUN_FLAG, as we can
+ * stop spinning once the kernel flags pending work.
+ */
+static bool cq_ring_can_spin(unsigned flags)
+{
+	if ((flags & (IORING_SETUP_IOPOLL | IORING_SETUP_SQPOLL)) ==
+	    IORING_SETUP_IOPOLL)
+		return false;
+	if (flags & IORING_SETUP_DEFER_TASKRUN)
+		return false;
+	if ((flags & (IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG)) ==
+	    IORING_SETUP_COOP_TASKRUN)
+		return false;
+	return true;
+}
+
+/*
+ * Poll the CQ ring for up to ring->cq.wait_spin iterations, waiting for
+ * 'wait_nr' completions to become available. Returns true if they did.
+ */
+static bool io_uring_cq_spin(struct io_uring *ring, unsigned wait_nr)
+{
+	unsigned budget = ring->cq.wait_spin;
+
+	do {
+		if (io_uring_cq_ready(ring) >= wait_nr) {
+			ring->cq.spin_hits++;
+			return true;
+		}
+		/* completions need a kernel transition to get posted */
+		if (cq_ring_needs_flush(ring))
+			break;
+		cpu_relax();
+	} while (--budget);
+
+	ring->cq.spin_misses++;
+	return false;
 }
 
+int __io_uring_flush_sq(struct io_uring *ring);
+static int __io_uring_submit(struct io_uring *ring, unsigned submitted,
+			     unsigned wait_nr);
+
 struct get_data {
 	unsigned submit;
 	unsigned wait_nr;
 	unsigned get_flags;
+	bool min_wait;		/* the kernel may return before 'wait_nr' */
 	int sz;
 	void *arg;
 };
@@ -56,9 +124,18 @@ static int _io_uring_get_cqe(struct io_uring *ring,
 			     struct get_data *data)
 {
 	struct io_uring_cqe *cqe = NULL;
-	bool looped = false;
+	bool looped = false, waited = false;
+	bool spun = !ring->cq.wait_spin;
 	int err;
 
+	/*
+	 * With auto-submit batching, sqes the application has queued up get
+	 * submitted as part of waiting, so a loop that queues requests and
+	 * then waits only needs the one system call.
+	 */
+	if (ring->sq.submit_batch && data->wait_nr)
+		data->submit = __io_uring_flush_sq(ring);
+
 	do {
 		bool need_enter = false;
 		unsigned flags = 0;
@@ -68,6 +145,14 @@ static int _io_uring_get_cqe(struct io_uring *ring,
 		err = __io_uring_peek_cqe(ring, &cqe, &nr_available);
 		if (err)
 			break;
+		/*
+		 * Once a min wait timeout expires, the kernel stops waiting
+		 * before 'wait_nr' completions are posted, so return what we
+		 * have rather than waiting again. Other waits, like IOPOLL
+		 * returning early to reschedule, go on until 'wait_nr'.
+		 */
+		if (cqe && waited && data->min_wait)
+			break;
 		if (!cqe && !data->wait_nr && !data->submit) {
 			/*
 			 * If we already looped once, we already entererd
@@ -80,6 +165,23 @@ static int _io_uring_get_cqe(struct io_uring *ring,
 			}
 			need_enter = true;
 		}
+		if (data->wait_nr > nr_available && !spun) {
+			spun = true;
+			/*
+			 * Submit without waiting first, what we're about to
+			 * spin for may well depend on it.
+			 */
+			if (data->submit) {
+				ret = __io_uring_submit(ring, data->submit, 0);
+				if (ret < 0) {
+					err = ret;
+					break;
+				}
+				data->submit -= ret;
+			}
+			if (io_uring_cq_spin(ring, data->wait_nr))
+				continue;
+		}
 		if (data->wait_nr > nr_available || need_enter) {
 			flags = IORING_ENTER_GETEVENTS | data->get_flags;
 			need_enter = true;
@@ -103,6 +205,8 @@ static int _io_uring_get_cqe(struct io_uring *ring,
 		if (cqe)
 			break;
 		looped = true;
+		if (flags & IORING_ENTER_GETEVENTS)
+			waited = true;
 	} while (1);
 
 	*cqe_ptr = cqe;
@@ -123,6 +227,62 @@ int __io_uring_get_cqe(struct io_uring *ring, struct io_uring_cqe **cqe_ptr,
 	return _io_uring_get_cqe(ring, cqe_ptr, &data);
 }
 
+/*
+ * Have waits for completions poll the CQ ring for up to 'nr_spins' iterations
+ * before going to sleep in the kernel, 0 disables spinning. This trades CPU
+ * time for lower completion latency, when completions are expected to arrive
+ * shortly after we start waiting for them.
+ */
+int io_uring_set_wait_spin(struct io_uring *ring, unsigned nr_spins)
+{
+	if (nr_spins && !cq_ring_can_spin(ring->flags))
+		return -EINVAL;
+
+	ring->cq.wait_spin = nr_spins;
+	return 0;
+}
+
+/*
+ * Return how many waits found their completions while spinning, and how many
+ * had to go to sleep in the kernel after spinning, since the last call.
+ */
+void io_uring_get_wait_spin_stats(struct io_uring *ring,
+				  struct io_uring_spin_stats *stats)
+{
+	stats->hits = ring->cq.spin_hits;
+	stats->misses = ring->cq.spin_misses;
+	ring->cq.spin_hits = ring->cq.spin_misses = 0;
+}
+
+/*
+ * Have io_uring_get_sqe() and io_uring_get_sqes() submit queued up sqes once
+ * 'batch' of them are pending, and waits for completions submit anything
+ * pending as part of waiting. 0 turns this off.
+ */
+int io_uring_set_submit_batch(struct io_uring *ring, unsigned batch)
+{
+	if (batch > *ring->sq.kring_entries)
+		return -EINVAL;
+
+	ring->sq.submit_batch = batch;
+	return 0;
+}
+
+/*
+ * Return how many times new sqes were submitted, how many sqes that was in
+ * total, and the biggest single batch, since the last call.
+ */
+void io_uring_get_submit_stats(struct io_uring *ring,
+			       struct io_uring_submit_stats *stats)
+{
+	struct io_uring_sq *sq = &ring->sq;
+
+	stats->submits = sq->nr_submits;
+	stats->sqes = sq->nr_submitted;
+	stats->max_batch = sq->max_submitted;
+	sq->nr_submits = sq->nr_submitted = sq->max_submitted = 0;
+}
+
 /*
  * Fill in an array of IO completions up to count, if any are available.
  * Returns the amount of IO completions filled.
@@ -138,13 +298,14 @@ again:
 	if (ready) {
 		unsigned head = *ring->cq.khead;
 		unsigned mask = *ring->cq.kring_mask;
+		int shift = io_uring_cqe_shift(ring);
 		unsigned last;
 		int i = 0;
 
 		count = count > ready ? ready : count;
 		last = head + count;
 		for (;head != last; head++, i++)
-			cqes[i] = &ring->cq.cqes[head & mask];
+			cqes[i] = &ring->cq.cqes[(head & mask) << shift];
 
 		return count;
 	}
@@ -152,12 +313,8 @@ again:
 	if (overflow_checked)
 		goto done;
 
-	if (cq_ring_needs_flush(ring)) {
-		int flags = IORING_ENTER_GETEVENTS;
-
-		if (ring->int_flags & INT_FLAG_REG_RING)
-			flags |= IORING_ENTER_REGISTERED_RING;
-		____sys_io_uring_enter(ring->enter_ring_fd, 0, 0, flags, NULL);
+	if (cq_ring_needs_enter(ring)) {
+		io_uring_get_events(ring);
 		overflow_checked = true;
 		goto again;
 	}
@@ -173,28 +330,28 @@ done:
 int __io_uring_flush_sq(struct io_uring *ring)
 {
 	struct io_uring_sq *sq = &ring->sq;
-	const unsigned mask = *sq->kring_mask;
-	unsigned ktail = *sq->ktail;
-	unsigned to_submit = sq->sqe_tail - sq->sqe_head;
-
-	if (!to_submit)
-		goto out;
+	unsigned tail = sq->sqe_tail;
 
 	/*
-	 * Fill in sqes that we have queued up, adding them to the kernel ring
+	 * The SQ array is set up as an identity mapping at ring init time,
+	 * so publishing the sqes we have queued up is just a matter of
+	 * moving the kernel tail, regardless of how many there are.
 	 */
-	do {
-		sq->array[ktail & mask] = sq->sqe_head & mask;
-		ktail++;
-		sq->sqe_head++;
-	} while (--to_submit);
+	if (sq->sqe_head != tail) {
+		unsigned nr = tail - sq->sqe_head;
+
+		sq->nr_submits++;
+		sq->nr_submitted += nr;
+		if (nr > sq->max_submitted)
+			sq->max_submitted = nr;
+		sq->sqe_head = tail;
+		/*
+		 * Ensure that the kernel sees the SQE updates before it sees
+		 * the tail update.
+		 */
+		io_uring_smp_store_release(sq->ktail, tail);
+	}
 
-	/*
-	 * Ensure that the kernel sees the SQE updates before it sees the tail
-	 * update.
-	 */
-	io_uring_smp_store_release(sq->ktail, ktail);
-out:
 	/*
 	 * This _may_ look problematic, as we're not supposed to be reading
 	 * SQ->head without acquire semantics. When we're in SQPOLL mode, the
@@ -206,7 +363,7 @@ out:
 	 * we can submit. The point is, we need to be able to deal with this
 	 * situation regardless of any perceived atomicity.
 	 */
-	return ktail - *sq->khead;
+	return tail - *sq->khead;
 }
 
 /*
@@ -292,25 +449,28 @@ int io_uring_wait_cqes(struct io_uring *ring, struct io_uring_cqe **cqe_ptr,
 	return __io_uring_get_cqe(ring, cqe_ptr, to_submit, wait_nr, sigmask);
 }
 
-int io_uring_submit_and_wait_timeout(struct io_uring *ring,
-				     struct io_uring_cqe **cqe_ptr,
-				     unsigned wait_nr,
-				     struct __kernel_timespec *ts,
-				     sigset_t *sigmask)
+static int __io_uring_submit_and_wait_timeout(struct io_uring *ring,
+					      struct io_uring_cqe **cqe_ptr,
+					      unsigned wait_nr,
+					      struct __kernel_timespec *ts,
+					      unsigned min_wait_usec,
+					      sigset_t *sigmask)
 {
 	int to_submit;
 
-	if (ts) {
+	if (ts || min_wait_usec) {
 		if (ring->features & IORING_FEAT_EXT_ARG) {
 			struct io_uring_getevents_arg arg = {
 				.sigmask	= (unsigned long) sigmask,
 				.sigmask_sz	= _NSIG / 8,
+				.min_wait_usec	= min_wait_usec,
 				.ts		= (unsigned long) ts
 			};
 			struct get_data data = {
 				.submit		= __io_uring_flush_sq(ring),
 				.wait_nr	= wait_nr,
 				.get_flags	= IORING_ENTER_EXT_ARG,
+				.min_wait	= min_wait_usec != 0,
 				.sz		= sizeof(arg),
 				.arg		= &arg
 			};
@@ -326,6 +486,37 @@ int io_uring_submit_and_wait_timeout(struct io_uring *ring,
 	return __io_uring_get_cqe(ring, cqe_ptr, to_submit, wait_nr, sigmask);
 }
 
+int io_uring_submit_and_wait_timeout(struct io_uring *ring,
+				     struct io_uring_cqe **cqe_ptr,
+				     unsigned wait_nr,
+				     struct __kernel_timespec *ts,
+				     sigset_t *sigmask)
+{
+	return __io_uring_submit_and_wait_timeout(ring, cqe_ptr, wait_nr, ts, 0,
+						  sigmask);
+}
+
+/*
+ * Like io_uring_submit_and_wait_timeout(), except the kernel only waits for
+ * the full 'wait_nr' completions for 'min_wait_usec' microseconds. After
+ * that, it returns as soon as any completion is available, or when 'ts'
+ * expires. If 'ts' is NULL, there's no overall timeout. Requires kernel
+ * support for IORING_FEAT_MIN_TIMEOUT.
+ */
+int io_uring_submit_and_wait_min_timeout(struct io_uring *ring,
+					 struct io_uring_cqe **cqe_ptr,
+					 unsigned wait_nr,
+					 struct __kernel_timespec *ts,
+					 unsigned min_wait_usec,
+					 sigset_t *sigmask)
+{
+	if (!(ring->features & IORING_FEAT_MIN_TIMEOUT))
+		return -EINVAL;
+
+	return __io_uring_submit_and_wait_timeout(ring, cqe_ptr, wait_nr, ts,
+						  min_wait_usec, sigmask);
+}
+
 /*
  * See io_uring_wait_cqes() - this function is the same, it just always uses
  * '1' as the wait_nr.
@@ -388,6 +579,99 @@ int io_uring_submit_and_wait(struct io_uring *ring, unsigned wait_nr)
 	return __io_uring_submit_and_wait(ring, wait_nr);
 }
 
+/*
+ * Set up 'q' as a multi-producer submission front-end for 'ring'. Once this
+ * is done, sqes must only be obtained through io_uring_mpsc_get_sqe() and
+ * submitted through io_uring_mpsc_flush() or io_uring_mpsc_submit(), until
+ * io_uring_mpsc_exit() is called. Returns 0 on success, -errno on failure.
+ */
+int io_uring_mpsc_init(struct io_uring_mpsc *q, struct io_uring *ring)
+{
+	size_t len = *ring->sq.kring_entries * sizeof(unsigned);
+
+	memset(q, 0, sizeof(*q));
+	q->ready = uring_malloc(len);
+	if (!q->ready)
+		return -ENOMEM;
+	memset(q->ready, 0, len);
+	q->ring = ring;
+	q->reserved = ring->sq.sqe_tail;
+	return 0;
+}
+
+void io_uring_mpsc_exit(struct io_uring_mpsc *q)
+{
+	uring_free(q->ready);
+	q->ready = NULL;
+}
+
+/*
+ * Get an sqe to fill, safe to call from any number of threads at the same
+ * time. Once filled in, it must be handed back with io_uring_mpsc_commit().
+ * Returns NULL if the SQ ring is full.
+ */
+struct io_uring_sqe *io_uring_mpsc_get_sqe(struct io_uring_mpsc *q)
+{
+	struct io_uring *ring = q->ring;
+	struct io_uring_sq *sq = &ring->sq;
+	_Atomic unsigned *reserved = (_Atomic unsigned *) &q->reserved;
+	unsigned entries = *sq->kring_entries;
+	unsigned tail;
+
+	/*
+	 * A slot can be reused once the kernel has consumed it, which it
+	 * signals by moving the SQ head past it. We can't just fetch-and-add
+	 * the reservation, as that would hand out slots on a full ring.
+	 */
+	tail = atomic_load_explicit(reserved, memory_order_relaxed);
+	do {
+		if (tail - io_uring_smp_load_acquire(sq->khead) >= entries)
+			return NULL;
+	} while (!atomic_compare_exchange_weak_explicit(reserved, &tail,
+							tail + 1,
+							memory_order_relaxed,
+							memory_order_relaxed));
+
+	return &sq->sqes[io_uring_sqe_index(ring, tail, *sq->kring_mask)];
+}
+
+/*
+ * Move the run of committed sqes following the ones flushed so far to the
+ * SQ ring, so that the next io_uring_submit() or variant thereof submits
+ * them. Slots that are still being filled in end the run, those and the
+ * ones after them are picked up by a later flush. Must only be called from
+ * one thread at a time. Returns the number of sqes added.
+ */
+unsigned io_uring_mpsc_flush(struct io_uring_mpsc *q)
+{
+	struct io_uring_sq *sq = &q->ring->sq;
+	unsigned mask = *sq->kring_mask;
+	unsigned start = sq->sqe_tail;
+	unsigned tail = start;
+
+	while (io_uring_smp_load_acquire(&q->ready[tail & mask])) {
+		/*
+		 * Ordered before the slot can be handed out again by the
+		 * release of the SQ tail in __io_uring_flush_sq().
+		 */
+		IO_URING_WRITE_ONCE(q->ready[tail & mask], 0U);
+		tail++;
+	}
+
+	sq->sqe_tail = tail;
+	return tail - start;
+}
+
+/*
+ * Flush committed sqes and submit them to the kernel. Returns the number of
+ * sqes submitted, or -errno.
+ */
+int io_uring_mpsc_submit(struct io_uring_mpsc *q)
+{
+	io_uring_mpsc_flush(q);
+	return io_uring_submit(q->ring);
+}
+
 #ifdef LIBURING_INTERNAL
 struct io_uring_sqe *io_uring_get_sqe(struct io_uring *ring)
 {
@@ -395,6 +679,21 @@ struct io_uring_sqe *io_uring_get_sqe(struct io_uring *ring)
 }
 #endif
 
+/*
+ * Flush any pending completions to the CQ ring, without waiting for any.
+ * This is required for rings set up with IORING_SETUP_DEFER_TASKRUN, as
+ * completions are otherwise only posted when waiting for events, and for
+ * rings that have overflowed completions pending.
+ */
+int io_uring_get_events(struct io_uring *ring)
+{
+	int flags = IORING_ENTER_GETEVENTS;
+
+	if (ring->int_flags & INT_FLAG_REG_RING)
+		flags |= IORING_ENTER_REGISTERED_RING;
+	return ____sys_io_uring_enter(ring->enter_ring_fd, 0, 0, flags, NULL);
+}
+
 int __io_uring_sqring_wait(struct io_uring *ring)
 {
 	int flags = IORING_ENTER_SQ_WAIT;
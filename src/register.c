@@ -51,6 +51,54 @@ int io_uring_register_buffers(struct io_uring *ring, const struct iovec *iovecs,
 	return (ret < 0) ? ret : 0;
 }
 
+/*
+ * Register a table of 'nr' empty buffer slots, to be filled in with
+ * io_uring_register_buffers_update_tag() or by cloning.
+ */
+int io_uring_register_buffers_sparse(struct io_uring *ring, unsigned nr)
+{
+	struct io_uring_rsrc_register reg = {
+		.flags = IORING_RSRC_REGISTER_SPARSE,
+		.nr = nr,
+	};
+
+	return ____sys_io_uring_register(ring->ring_fd,
+					 IORING_REGISTER_BUFFERS2, &reg,
+					 sizeof(reg));
+}
+
+/*
+ * Copy 'nr' registered buffers of 'src', starting at 'src_off', into the
+ * buffer table of 'dst' at 'dst_off'. The buffers share the pages pinned by
+ * 'src', nothing is pinned or accounted again.
+ */
+int io_uring_clone_buffers_offset(struct io_uring *dst, struct io_uring *src,
+				  unsigned dst_off, unsigned src_off,
+				  unsigned nr, unsigned flags)
+{
+	/*
+	 * Registered ring fds only exist in the thread that registered them,
+	 * and cloning is typically done from other threads, so always pass
+	 * the real fd of 'src' and never IORING_REGISTER_SRC_REGISTERED.
+	 */
+	struct io_uring_clone_buffers buf = {
+		.src_fd = src->ring_fd,
+		.flags = flags & ~IORING_REGISTER_SRC_REGISTERED,
+		.src_off = src_off,
+		.dst_off = dst_off,
+		.nr = nr,
+	};
+
+	return ____sys_io_uring_register(dst->ring_fd,
+					 IORING_REGISTER_CLONE_BUFFERS, &buf, 1);
+}
+
+/* Clone the whole registered buffer table of 'src' into 'dst' */
+int io_uring_clone_buffers(struct io_uring *dst, struct io_uring *src)
+{
+	return io_uring_clone_buffers_offset(dst, src, 0, 0, 0, 0);
+}
+
 int io_uring_unregister_buffers(struct io_uring *ring)
 {
 	int ret;
@@ -140,6 +188,35 @@ int io_uring_register_files_tags(struct io_uring *ring, const int *files,
 	return ret;
 }
 
+/*
+ * Register a table of 'nr' empty slots, to be filled in by updates or by
+ * requests instantiating direct descriptors.
+ */
+int io_uring_register_files_sparse(struct io_uring *ring, unsigned nr)
+{
+	struct io_uring_rsrc_register reg = {
+		.flags = IORING_RSRC_REGISTER_SPARSE,
+		.nr = nr,
+	};
+	int ret, did_increase = 0;
+
+	do {
+		ret = ____sys_io_uring_register(ring->ring_fd,
+						IORING_REGISTER_FILES2, &reg,
+						sizeof(reg));
+		if (ret >= 0)
+			break;
+		if (ret == -EMFILE && !did_increase) {
+			did_increase = 1;
+			increase_rlimit_nofile(nr);
+			continue;
+		}
+		break;
+	} while (1);
+
+	return ret;
+}
+
 int io_uring_register_files(struct io_uring *ring, const int *files,
 			    unsigned nr_files)
 {
@@ -171,6 +248,35 @@ int io_uring_unregister_files(struct io_uring *ring)
 	return (ret < 0) ? ret : 0;
 }
 
+/*
+ * Restrict the slots the kernel picks from for IORING_FILE_INDEX_ALLOC to
+ * 'len' slots starting at 'off' in the registered file table.
+ */
+int io_uring_register_file_alloc_range(struct io_uring *ring,
+				       unsigned off, unsigned len)
+{
+	struct io_uring_file_index_range range = {
+		.off = off,
+		.len = len,
+	};
+
+	return ____sys_io_uring_register(ring->ring_fd,
+					 IORING_REGISTER_FILE_ALLOC_RANGE,
+					 &range, 0);
+}
+
+/*
+ * Cancel the requests matching 'reg' and wait for them to complete, rather
+ * than issuing an IORING_OP_ASYNC_CANCEL and reaping its cqe. Waits at most
+ * reg->timeout, unless both its fields are -1.
+ */
+int io_uring_register_sync_cancel(struct io_uring *ring,
+				  struct io_uring_sync_cancel_reg *reg)
+{
+	return ____sys_io_uring_register(ring->ring_fd,
+					 IORING_REGISTER_SYNC_CANCEL, reg, 1);
+}
+
 int io_uring_register_eventfd(struct io_uring *ring, int event_fd)
 {
 	int ret;
@@ -293,3 +399,19 @@ int io_uring_unregister_ring_fd(struct io_uring *ring)
 	}
 	return ret;
 }
+
+int io_uring_register_buf_ring(struct io_uring *ring,
+			       struct io_uring_buf_reg *reg, unsigned int flags)
+{
+	reg->flags |= flags;
+	return ____sys_io_uring_register(ring->ring_fd,
+					 IORING_REGISTER_PBUF_RING, reg, 1);
+}
+
+int io_uring_unregister_buf_ring(struct io_uring *ring, int bgid)
+{
+	struct io_uring_buf_reg reg = { .bgid = bgid };
+
+	return ____sys_io_uring_register(ring->ring_fd,
+					 IORING_UNREGISTER_PBUF_RING, &reg, 1);
+}
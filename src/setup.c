@@ -8,6 +8,103 @@
 #include "liburing/compat.h"
 #include "liburing/io_uring.h"
 
+/*
+ * Size of a single SQE/CQE for the given setup flags
+ */
+static inline size_t sqe_size(unsigned flags)
+{
+	if (flags & IORING_SETUP_SQE128)
+		return 2 * sizeof(struct io_uring_sqe);
+	return sizeof(struct io_uring_sqe);
+}
+
+static inline size_t cqe_size(unsigned flags)
+{
+	if (flags & IORING_SETUP_CQE32)
+		return 2 * sizeof(struct io_uring_cqe);
+	return sizeof(struct io_uring_cqe);
+}
+
+static inline int __fls(int x)
+{
+	if (!x)
+		return 0;
+	return 8 * sizeof(x) - __builtin_clz(x);
+}
+
+static unsigned roundup_pow2(unsigned depth)
+{
+	return 1UL << __fls(depth - 1);
+}
+
+static size_t npages(size_t size, unsigned page_size)
+{
+	size--;
+	size /= page_size;
+	return __fls(size);
+}
+
+#define KRING_SIZE	320
+
+/*
+ * Size of the SQ/CQ ring region: the shared ring header, the CQEs and, if
+ * used, the SQ index array.
+ */
+static size_t rings_mem(struct io_uring_params *p, unsigned entries,
+			unsigned cq_entries)
+{
+	size_t cq_size;
+
+	cq_size = KRING_SIZE;
+	cq_size += cq_entries * cqe_size(p->flags);
+	cq_size = (cq_size + 63) & ~63UL;
+	if (!(p->flags & IORING_SETUP_NO_SQARRAY))
+		cq_size += entries * sizeof(unsigned);
+	return cq_size;
+}
+
+#define KERN_MAX_ENTRIES	32768
+#define KERN_MAX_CQ_ENTRIES	(2 * KERN_MAX_ENTRIES)
+
+/*
+ * Calculate the SQ and CQ ring sizes the kernel will use for a given
+ * 'entries' and setup parameters.
+ */
+static int get_sq_cq_entries(unsigned entries, struct io_uring_params *p,
+			     unsigned *sq, unsigned *cq)
+{
+	unsigned cq_entries;
+
+	if (!entries)
+		return -EINVAL;
+	if (entries > KERN_MAX_ENTRIES) {
+		if (!(p->flags & IORING_SETUP_CLAMP))
+			return -EINVAL;
+		entries = KERN_MAX_ENTRIES;
+	}
+
+	entries = roundup_pow2(entries);
+	if (p->flags & IORING_SETUP_CQSIZE) {
+		if (!p->cq_entries)
+			return -EINVAL;
+		cq_entries = p->cq_entries;
+		if (cq_entries > KERN_MAX_CQ_ENTRIES) {
+			if (!(p->flags & IORING_SETUP_CLAMP))
+				return -EINVAL;
+			cq_entries = KERN_MAX_CQ_ENTRIES;
+		}
+		cq_entries = roundup_pow2(cq_entries);
+		if (cq_entries < entries)
+			return -EINVAL;
+	} else {
+		cq_entries = 2 * entries;
+	}
+
+	*sq = entries;
+	*cq = cq_entries;
+	return 0;
+}
+
 static void io_uring_unmap_rings(struct io_uring_sq *sq, struct io_uring_cq *cq)
 {
 	__sys_munmap(sq->ring_ptr, sq->ring_sz);
@@ -15,14 +112,57 @@ static void io_uring_unmap_rings(struct io_uring_sq *sq, struct io_uring_cq *cq)
 		__sys_munmap(cq->ring_ptr, cq->ring_sz);
 }
 
+static void io_uring_setup_ring_pointers(struct io_uring_params *p,
+					 struct io_uring_sq *sq,
+					 struct io_uring_cq *cq)
+{
+	unsigned index;
+
+	sq->khead = sq->ring_ptr + p->sq_off.head;
+	sq->ktail = sq->ring_ptr + p->sq_off.tail;
+	sq->kring_mask = sq->ring_ptr + p->sq_off.ring_mask;
+	sq->kring_entries = sq->ring_ptr + p->sq_off.ring_entries;
+	sq->kflags = sq->ring_ptr + p->sq_off.flags;
+	sq->kdropped = sq->ring_ptr + p->sq_off.dropped;
+	if (!(p->flags & IORING_SETUP_NO_SQARRAY))
+		sq->array = sq->ring_ptr + p->sq_off.array;
+
+	/*
+	 * Directly map SQ slots to SQEs. This lets __io_uring_flush_sq()
+	 * publish any number of queued sqes with a single tail update. If
+	 * the ring has no SQ array, the kernel does this mapping itself.
+	 */
+	if (sq->array) {
+		for (index = 0; index < p->sq_entries; index++)
+			sq->array[index] = index;
+	}
+
+	cq->khead = cq->ring_ptr + p->cq_off.head;
+	cq->ktail = cq->ring_ptr + p->cq_off.tail;
+	cq->kring_mask = cq->ring_ptr + p->cq_off.ring_mask;
+	cq->kring_entries = cq->ring_ptr + p->cq_off.ring_entries;
+	cq->koverflow = cq->ring_ptr + p->cq_off.overflow;
+	cq->cqes = cq->ring_ptr + p->cq_off.cqes;
+	if (p->cq_off.flags)
+		cq->kflags = cq->ring_ptr + p->cq_off.flags;
+}
+
 static int io_uring_mmap(int fd, struct io_uring_params *p,
 			 struct io_uring_sq *sq, struct io_uring_cq *cq)
 {
 	size_t size;
 	int ret;
 
-	sq->ring_sz = p->sq_off.array + p->sq_entries * sizeof(unsigned);
-	cq->ring_sz = p->cq_off.cqes + p->cq_entries * sizeof(struct io_uring_cqe);
+	/*
+	 * Without an SQ index array, the SQ ring fields all live in the
+	 * shared ring header, which is covered by the CQ ring mapping.
+	 */
+	if (p->flags & IORING_SETUP_NO_SQARRAY)
+		sq->ring_sz = 0;
+	else
+		sq->ring_sz = p->sq_off.array +
+				p->sq_entries * sizeof(unsigned);
+	cq->ring_sz = p->cq_off.cqes + p->cq_entries * cqe_size(p->flags);
 
 	if (p->features & IORING_FEAT_SINGLE_MMAP) {
 		if (cq->ring_sz > sq->ring_sz)
@@ -48,15 +188,7 @@ static int io_uring_mmap(int fd, struct io_uring_params *p,
 		}
 	}
 
-	sq->khead = sq->ring_ptr + p->sq_off.head;
-	sq->ktail = sq->ring_ptr + p->sq_off.tail;
-	sq->kring_mask = sq->ring_ptr + p->sq_off.ring_mask;
-	sq->kring_entries = sq->ring_ptr + p->sq_off.ring_entries;
-	sq->kflags = sq->ring_ptr + p->sq_off.flags;
-	sq->kdropped = sq->ring_ptr + p->sq_off.dropped;
-	sq->array = sq->ring_ptr + p->sq_off.array;
-
-	size = p->sq_entries * sizeof(struct io_uring_sqe);
+	size = p->sq_entries * sqe_size(p->flags);
 	sq->sqes = __sys_mmap(0, size, PROT_READ | PROT_WRITE,
 			      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
 	if (IS_ERR(sq->sqes)) {
@@ -66,14 +198,7 @@ err:
 		return ret;
 	}
 
-	cq->khead = cq->ring_ptr + p->cq_off.head;
-	cq->ktail = cq->ring_ptr + p->cq_off.tail;
-	cq->kring_mask = cq->ring_ptr + p->cq_off.ring_mask;
-	cq->kring_entries = cq->ring_ptr + p->cq_off.ring_entries;
-	cq->koverflow = cq->ring_ptr + p->cq_off.overflow;
-	cq->cqes = cq->ring_ptr + p->cq_off.cqes;
-	if (p->cq_off.flags)
-		cq->kflags = cq->ring_ptr + p->cq_off.flags;
+	io_uring_setup_ring_pointers(p, sq, cq);
 	return 0;
 }
 
@@ -97,6 +222,99 @@ int io_uring_queue_mmap(int fd, struct io_uring_params *p, struct io_uring *ring
 	return ret;
 }
 
+#define HUGE_PAGE_SIZE		(2 * 1024 * 1024UL)
+
+static inline size_t page_align(size_t size, unsigned long page_size)
+{
+	return (size + page_size - 1) & ~(page_size - 1);
+}
+
+/*
+ * Regions that the library allocates for IORING_SETUP_NO_MMAP rings use a
+ * normal page if they fit in one, or a huge page otherwise. The kernel needs
+ * multi-page regions to be physically contiguous.
+ */
+static size_t no_mmap_region_size(size_t size, unsigned long page_size)
+{
+	if (size <= page_size)
+		return page_size;
+	return HUGE_PAGE_SIZE;
+}
+
+static void *no_mmap_region_alloc(size_t size, unsigned long page_size)
+{
+	int flags = MAP_SHARED | MAP_ANONYMOUS;
+
+	if (size > page_size)
+		flags |= MAP_HUGETLB;
+	return __sys_mmap(NULL, size, PROT_READ | PROT_WRITE, flags, -1, 0);
+}
+
+/*
+ * Set up the memory for a ring created with IORING_SETUP_NO_MMAP. The SQEs
+ * come first, followed by the SQ/CQ rings, each starting on a page boundary.
+ * If 'buf' is given, the rings are placed in it, otherwise the library
+ * allocates them. Returns the number of bytes of 'buf' used, or -errno.
+ */
+static int io_uring_alloc_mem(unsigned entries, struct io_uring_params *p,
+			      struct io_uring_sq *sq, struct io_uring_cq *cq,
+			      void *buf, size_t buf_size)
+{
+	unsigned long page_size = get_page_size();
+	unsigned sq_entries, cq_entries;
+	size_t sqes_mem, ring_mem;
+	int ret;
+
+	ret = get_sq_cq_entries(entries, p, &sq_entries, &cq_entries);
+	if (ret)
+		return ret;
+
+	sqes_mem = page_align(sq_entries * sqe_size(p->flags), page_size);
+	ring_mem = page_align(rings_mem(p, sq_entries, cq_entries), page_size);
+
+	if (buf) {
+		if ((unsigned long) buf & (page_size - 1))
+			return -EINVAL;
+		if (sqes_mem + ring_mem > buf_size)
+			return -ENOMEM;
+		sq->sqes = buf;
+		sq->ring_ptr = buf + sqes_mem;
+	} else {
+		if (sqes_mem > HUGE_PAGE_SIZE || ring_mem > HUGE_PAGE_SIZE)
+			return -ENOMEM;
+
+		sqes_mem = no_mmap_region_size(sqes_mem, page_size);
+		sq->sqes = no_mmap_region_alloc(sqes_mem, page_size);
+		if (IS_ERR(sq->sqes))
+			return PTR_ERR(sq->sqes);
+
+		ring_mem = no_mmap_region_size(ring_mem, page_size);
+		sq->ring_ptr = no_mmap_region_alloc(ring_mem, page_size);
+		if (IS_ERR(sq->ring_ptr)) {
+			ret = PTR_ERR(sq->ring_ptr);
+			__sys_munmap(sq->sqes, sqes_mem);
+			return ret;
+		}
+	}
+
+	cq->ring_ptr = sq->ring_ptr;
+	sq->ring_sz = cq->ring_sz = ring_mem;
+	p->sq_off.user_addr = (unsigned long) sq->sqes;
+	p->cq_off.user_addr = (unsigned long) sq->ring_ptr;
+	return (int) (sqes_mem + ring_mem);
+}
+
+static void io_uring_free_mem(struct io_uring *ring, unsigned sq_entries)
+{
+	struct io_uring_sq *sq = &ring->sq;
+	size_t sqes_mem;
+
+	sqes_mem = page_align(sq_entries * sqe_size(ring->flags),
+			      get_page_size());
+	__sys_munmap(sq->sqes, no_mmap_region_size(sqes_mem, get_page_size()));
+	io_uring_unmap_rings(sq, &ring->cq);
+}
+
 /*
  * Ensure that the mmap'ed rings aren't available to a child after a fork(2).
  * This uses madvise(..., MADV_DONTFORK) on the mmap'ed ranges.
@@ -109,7 +327,7 @@ int io_uring_ring_dontfork(struct io_uring *ring)
 	if (!ring->sq.ring_ptr || !ring->sq.sqes || !ring->cq.ring_ptr)
 		return -EINVAL;
 
-	len = *ring->sq.kring_entries * sizeof(struct io_uring_sqe);
+	len = *ring->sq.kring_entries * sqe_size(ring->flags);
 	ret = __sys_madvise(ring->sq.sqes, len, MADV_DONTFORK);
 	if (ret < 0)
 		return ret;
@@ -129,23 +347,75 @@ int io_uring_ring_dontfork(struct io_uring *ring)
 	return 0;
 }
 
-int io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
-			       struct io_uring_params *p)
+static int __io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
+					struct io_uring_params *p, void *buf,
+					size_t buf_size)
 {
-	int fd, ret;
+	int fd, ret = 0;
+
+	memset(ring, 0, sizeof(*ring));
+
+	if (p->flags & IORING_SETUP_NO_MMAP) {
+		ret = io_uring_alloc_mem(entries, p, &ring->sq, &ring->cq, buf,
+					 buf_size);
+		if (ret < 0)
+			return ret;
+		ring->flags = p->flags;
+		if (buf)
+			ring->int_flags |= INT_FLAG_APP_MEM;
+	}
 
 	fd = ____sys_io_uring_setup(entries, p);
-	if (fd < 0)
+	if (fd < 0) {
+		if ((p->flags & IORING_SETUP_NO_MMAP) &&
+		    !(ring->int_flags & INT_FLAG_APP_MEM)) {
+			unsigned sq_entries, cq_entries;
+
+			get_sq_cq_entries(entries, p, &sq_entries, &cq_entries);
+			io_uring_free_mem(ring, sq_entries);
+		}
 		return fd;
+	}
 
-	ret = io_uring_queue_mmap(fd, p, ring);
-	if (ret) {
-		__sys_close(fd);
-		return ret;
+	if (!(p->flags & IORING_SETUP_NO_MMAP)) {
+		ret = io_uring_queue_mmap(fd, p, ring);
+		if (ret) {
+			__sys_close(fd);
+			return ret;
+		}
+	} else {
+		io_uring_setup_ring_pointers(p, &ring->sq, &ring->cq);
+		ring->ring_fd = ring->enter_ring_fd = fd;
 	}
 
 	ring->features = p->features;
-	return 0;
+	return ret;
+}
+
+int io_uring_queue_init_params(unsigned entries, struct io_uring *ring,
+			       struct io_uring_params *p)
+{
+	int ret;
+
+	ret = __io_uring_queue_init_params(entries, ring, p, NULL, 0);
+	return ret >= 0 ? 0 : ret;
+}
+
+/*
+ * Like io_uring_queue_init_params(), except the SQ/CQ rings and SQEs are
+ * placed in the application provided memory 'buf' of 'buf_size' bytes,
+ * using IORING_SETUP_NO_MMAP. 'buf' must be page aligned. Returns the
+ * number of bytes used, which is a multiple of the page size, so that
+ * further rings can be placed after it in the same buffer. The memory
+ * must stay valid until the ring has been torn down.
+ */
+int io_uring_queue_init_mem(unsigned entries, struct io_uring *ring,
+			    struct io_uring_params *p,
+			    void *buf, size_t buf_size)
+{
+	/* should already be set... */
+	p->flags |= IORING_SETUP_NO_MMAP;
+	return __io_uring_queue_init_params(entries, ring, p, buf, buf_size);
 }
 
 /*
@@ -167,8 +437,17 @@ void io_uring_queue_exit(struct io_uring *ring)
 	struct io_uring_sq *sq = &ring->sq;
 	struct io_uring_cq *cq = &ring->cq;
 
-	__sys_munmap(sq->sqes, *sq->kring_entries * sizeof(struct io_uring_sqe));
-	io_uring_unmap_rings(sq, cq);
+	/*
+	 * Rings living in application provided memory are left alone, the
+	 * application owns that memory.
+	 */
+	if (!(ring->flags & IORING_SETUP_NO_MMAP)) {
+		__sys_munmap(sq->sqes,
+			     *sq->kring_entries * sqe_size(ring->flags));
+		io_uring_unmap_rings(sq, cq);
+	} else if (!(ring->int_flags & INT_FLAG_APP_MEM)) {
+		io_uring_free_mem(ring, *sq->kring_entries);
+	}
 	/*
 	 * Not strictly required, but frees up the slot we used now rather
 	 * than at process exit time.
@@ -178,6 +457,61 @@ void io_uring_queue_exit(struct io_uring *ring)
 	__sys_close(ring->ring_fd);
 }
 
+/*
+ * Allocate and register a provided buffer ring of 'nentries' for buffer
+ * group 'bgid'. The ring is backed by anonymous memory, so it's page
+ * aligned as the kernel requires. Returns the initialized ring on
+ * success, or NULL with the error stored in 'ret' on failure.
+ */
+struct io_uring_buf_ring *io_uring_setup_buf_ring(struct io_uring *ring,
+						  unsigned int nentries,
+						  int bgid, unsigned int flags,
+						  int *ret)
+{
+	struct io_uring_buf_ring *br;
+	struct io_uring_buf_reg reg;
+	size_t ring_size;
+	int lret;
+
+	memset(&reg, 0, sizeof(reg));
+	ring_size = nentries * sizeof(struct io_uring_buf);
+	br = __sys_mmap(NULL, ring_size, PROT_READ | PROT_WRITE,
+			MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
+	if (IS_ERR(br)) {
+		*ret = PTR_ERR(br);
+		return NULL;
+	}
+
+	reg.ring_addr = (unsigned long) (uintptr_t) br;
+	reg.ring_entries = nentries;
+	reg.bgid = bgid;
+
+	*ret = 0;
+	lret = io_uring_register_buf_ring(ring, &reg, flags);
+	if (lret) {
+		__sys_munmap(br, ring_size);
+		*ret = lret;
+		br = NULL;
+	} else {
+		io_uring_buf_ring_init(br);
+	}
+
+	return br;
+}
+
+int io_uring_free_buf_ring(struct io_uring *ring, struct io_uring_buf_ring *br,
+			   unsigned int nentries, int bgid)
+{
+	int ret;
+
+	ret = io_uring_unregister_buf_ring(ring, bgid);
+	if (ret)
+		return ret;
+
+	__sys_munmap(br, nentries * sizeof(struct io_uring_buf));
+	return 0;
+}
+
 struct io_uring_probe *io_uring_get_probe_ring(struct io_uring *ring)
 {
 	struct io_uring_probe *probe;
@@ -198,65 +532,201 @@ struct io_uring_probe *io_uring_get_probe_ring(struct io_uring *ring)
 	return NULL;
 }
 
-struct io_uring_probe *io_uring_get_probe(void)
+/*
+ * Setup flags probed for io_uring_get_caps(), along with the flags each one
+ * needs to be accepted on its own. IORING_SETUP_NO_MMAP needs application
+ * memory for the rings, and isn't probed.
+ */
+static const struct {
+	unsigned flag;
+	unsigned needs;
+} setup_probes[] = {
+	{ IORING_SETUP_IOPOLL,		0 },
+	{ IORING_SETUP_SQPOLL,		0 },
+	{ IORING_SETUP_SQ_AFF,		IORING_SETUP_SQPOLL },
+	{ IORING_SETUP_CQSIZE,		0 },
+	{ IORING_SETUP_CLAMP,		0 },
+	{ IORING_SETUP_ATTACH_WQ,	0 },
+	{ IORING_SETUP_R_DISABLED,	0 },
+	{ IORING_SETUP_SUBMIT_ALL,	0 },
+	{ IORING_SETUP_COOP_TASKRUN,	0 },
+	{ IORING_SETUP_TASKRUN_FLAG,	IORING_SETUP_COOP_TASKRUN },
+	{ IORING_SETUP_SQE128,		0 },
+	{ IORING_SETUP_CQE32,		0 },
+	{ IORING_SETUP_SINGLE_ISSUER,	0 },
+	{ IORING_SETUP_DEFER_TASKRUN,	IORING_SETUP_SINGLE_ISSUER },
+	{ IORING_SETUP_NO_SQARRAY,	0 },
+};
+
+/*
+ * Running out of fds or memory may be temporary, so probing is retried
+ * later. Anything else, like io_uring being blocked by seccomp or the
+ * io_uring_disabled sysctl with -EPERM or -ENOSYS, won't change.
+ */
+static bool caps_err_transient(int err)
 {
-	struct io_uring ring;
-	struct io_uring_probe *probe;
-	int r;
+	return err == -EMFILE || err == -ENFILE || err == -ENOMEM;
+}
 
-	r = io_uring_queue_init(2, &ring, 0);
-	if (r < 0)
-		return NULL;
+/*
+ * Returns 1 if 'flags' are accepted, 0 if they're rejected, and -errno if
+ * the setup failed for reasons that say nothing about the flags, like
+ * running out of fds or memory.
+ */
+static int setup_flags_supported(unsigned flags, int wq_fd)
+{
+	struct io_uring_params p;
+	int fd;
 
-	probe = io_uring_get_probe_ring(&ring);
-	io_uring_queue_exit(&ring);
-	return probe;
+	memset(&p, 0, sizeof(p));
+	p.flags = flags;
+	p.cq_entries = 2;
+	p.wq_fd = wq_fd;
+	fd = ____sys_io_uring_setup(1, &p);
+	if (fd < 0)
+		return caps_err_transient(fd) ? fd : 0;
+	__sys_close(fd);
+	return 1;
 }
 
-void io_uring_free_probe(struct io_uring_probe *probe)
+/*
+ * Fill in 'caps' from a ring that is set up but never mapped, as only its
+ * fd is needed to probe opcodes and attach to. Whatever the kernel refuses
+ * for good is left out, down to an empty table if io_uring can't be used at
+ * all. Returns 0 on success, or -errno if a transient error got in the way,
+ * in which case 'caps' must not be used.
+ */
+static int caps_build(struct io_uring_caps *caps)
 {
-	uring_free(probe);
+	__u64 buf[(sizeof(struct io_uring_probe) +
+		   256 * sizeof(struct io_uring_probe_op)) / sizeof(__u64)];
+	struct io_uring_probe *probe = (struct io_uring_probe *) buf;
+	struct io_uring_params p;
+	unsigned i;
+	int fd, ret;
+
+	memset(caps, 0, sizeof(*caps));
+	memset(&p, 0, sizeof(p));
+	fd = ____sys_io_uring_setup(2, &p);
+	if (fd < 0)
+		return caps_err_transient(fd) ? fd : 0;
+	caps->features = p.features;
+
+	memset(buf, 0, sizeof(buf));
+	ret = ____sys_io_uring_register(fd, IORING_REGISTER_PROBE, probe, 256);
+	if (ret < 0 && caps_err_transient(ret))
+		goto out;
+	if (ret >= 0) {
+		caps->probed = 1;
+		caps->last_op = probe->last_op;
+		caps->ops_len = probe->ops_len;
+		for (i = 0; i < probe->ops_len; i++) {
+			if (probe->ops[i].flags & IO_URING_OP_SUPPORTED)
+				caps->ops[i / 64] |= 1ULL << (i % 64);
+		}
+	}
+
+	for (i = 0; i < sizeof(setup_probes) / sizeof(setup_probes[0]); i++) {
+		ret = setup_flags_supported(setup_probes[i].flag |
+					    setup_probes[i].needs, fd);
+		if (ret < 0)
+			goto out;
+		if (ret)
+			caps->setup_flags |= setup_probes[i].flag;
+	}
+	ret = 0;
+out:
+	__sys_close(fd);
+	return ret;
 }
 
-static inline int __fls(int x)
+enum {
+	CAPS_NONE,
+	CAPS_BUILDING,
+	CAPS_READY,
+};
+
+static struct io_uring_caps caps;
+static const struct io_uring_caps caps_unknown;
+static int caps_state;
+
+/*
+ * The kernel doesn't change under us, so the capabilities are probed on the
+ * first call and served from the same table ever after. Threads racing on
+ * the first call each probe, and the first to finish publishes its result.
+ * A probe that fails for lack of fds or memory isn't published, and callers
+ * get an empty table until a later call manages to probe. If io_uring is
+ * unavailable, the empty table is published like any other.
+ */
+const struct io_uring_caps *io_uring_get_caps(void)
 {
-	if (!x)
-		return 0;
-	return 8 * sizeof(x) - __builtin_clz(x);
+	_Atomic int *state = (_Atomic int *) &caps_state;
+	struct io_uring_caps local;
+	int s;
+
+	if (atomic_load_explicit(state, memory_order_acquire) == CAPS_READY)
+		return &caps;
+
+	if (caps_build(&local))
+		return &caps_unknown;
+	s = CAPS_NONE;
+	if (atomic_compare_exchange_strong_explicit(state, &s, CAPS_BUILDING,
+						    memory_order_acquire,
+						    memory_order_acquire)) {
+		caps = local;
+		atomic_store_explicit(state, CAPS_READY, memory_order_release);
+		return &caps;
+	}
+	/* someone else is copying in the same result, won't take long */
+	while (atomic_load_explicit(state, memory_order_acquire) != CAPS_READY)
+		cpu_relax();
+	return &caps;
 }
 
-static unsigned roundup_pow2(unsigned depth)
+struct io_uring_probe *io_uring_get_probe(void)
 {
-	return 1UL << __fls(depth - 1);
+	const struct io_uring_caps *c = io_uring_get_caps();
+	struct io_uring_probe *probe;
+	size_t len;
+	int i;
+
+	if (!c->probed)
+		return NULL;
+
+	len = sizeof(*probe) + 256 * sizeof(struct io_uring_probe_op);
+	probe = uring_malloc(len);
+	if (!probe)
+		return NULL;
+	memset(probe, 0, len);
+
+	probe->last_op = c->last_op;
+	probe->ops_len = c->ops_len;
+	for (i = 0; i < c->ops_len; i++) {
+		probe->ops[i].op = i;
+		if (io_uring_caps_opcode_supported(c, i))
+			probe->ops[i].flags = IO_URING_OP_SUPPORTED;
+	}
+	return probe;
 }
 
-static size_t npages(size_t size, unsigned page_size)
+void io_uring_free_probe(struct io_uring_probe *probe)
 {
-	size--;
-	size /= page_size;
-	return __fls(size);
+	uring_free(probe);
 }
 
-#define KRING_SIZE	320
-
-static size_t rings_size(unsigned entries, unsigned cq_entries,
-			 unsigned page_size)
+static size_t rings_size(struct io_uring_params *p, unsigned entries,
+			 unsigned cq_entries, unsigned page_size)
 {
 	size_t pages, sq_size, cq_size;
 
-	cq_size = KRING_SIZE;
-	cq_size += cq_entries * sizeof(struct io_uring_cqe);
-	cq_size = (cq_size + 63) & ~63UL;
+	cq_size = rings_mem(p, entries, cq_entries);
 	pages = (size_t) 1 << npages(cq_size, page_size);
 
-	sq_size = sizeof(struct io_uring_sqe) * entries;
+	sq_size = sqe_size(p->flags) * entries;
 	pages += (size_t) 1 << npages(sq_size, page_size);
 	return pages * page_size;
 }
 
-#define KERN_MAX_ENTRIES	32768
-#define KERN_MAX_CQ_ENTRIES	(2 * KERN_MAX_ENTRIES)
-
 /*
  * Return the required ulimit -l memlock memory required for a given ring
  * setup, in bytes. May return -errno on error. On newer (5.12+) kernels,
@@ -291,33 +761,12 @@ ssize_t io_uring_mlock_size_params(unsigned entries, struct io_uring_params *p)
 	if (lp.features & IORING_FEAT_NATIVE_WORKERS)
 		return 0;
 
-	if (!entries)
-		return -EINVAL;
-	if (entries > KERN_MAX_ENTRIES) {
-		if (!(p->flags & IORING_SETUP_CLAMP))
-			return -EINVAL;
-		entries = KERN_MAX_ENTRIES;
-	}
-
-	entries = roundup_pow2(entries);
-	if (p->flags & IORING_SETUP_CQSIZE) {
-		if (!p->cq_entries)
-			return -EINVAL;
-		cq_entries = p->cq_entries;
-		if (cq_entries > KERN_MAX_CQ_ENTRIES) {
-			if (!(p->flags & IORING_SETUP_CLAMP))
-				return -EINVAL;
-			cq_entries = KERN_MAX_CQ_ENTRIES;
-		}
-		cq_entries = roundup_pow2(cq_entries);
-		if (cq_entries < entries)
-			return -EINVAL;
-	} else {
-		cq_entries = 2 * entries;
-	}
+	ret = get_sq_cq_entries(entries, p, &entries, &cq_entries);
+	if (ret)
+		return ret;
 
 	page_size = get_page_size();
-	return rings_size(entries, cq_entries, page_size);
+	return rings_size(p, entries, cq_entries, page_size);
 }
 
 /*
@@ -3,6 +3,7 @@
 #define LIBURING_SYSCALL_H
 
 #include <errno.h>
+#include <fcntl.h>
 #include <signal.h>
 #include <stdint.h>
 #include <unistd.h>
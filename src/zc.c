@@ -0,0 +1,109 @@
+/* SPDX-License-Identifier: MIT */
+#define _DEFAULT_SOURCE
+
+#include "lib.h"
+#include "liburing.h"
+#include "liburing/compat.h"
+#include "liburing/io_uring.h"
+
+#define ZC_SLOT_BUSY	1U	/* handed out, request in flight */
+#define ZC_SLOT_RESULT	2U	/* result cqe seen */
+#define ZC_SLOT_NOTIF	4U	/* buffer released, or never held */
+
+int io_uring_zc_tracker_init(struct io_uring_zc_tracker *t, unsigned nr_slots,
+			     __u64 user_data_base)
+{
+	unsigned i;
+
+	memset(t, 0, sizeof(*t));
+	if (!nr_slots || user_data_base + nr_slots < user_data_base)
+		return -EINVAL;
+
+	t->slots = uring_malloc(nr_slots * sizeof(*t->slots));
+	t->free = uring_malloc(nr_slots * sizeof(*t->free));
+	if (!t->slots || !t->free) {
+		uring_free(t->slots);
+		uring_free(t->free);
+		return -ENOMEM;
+	}
+	memset(t->slots, 0, nr_slots * sizeof(*t->slots));
+
+	/* hand out low slots first */
+	for (i = 0; i < nr_slots; i++)
+		t->free[i] = nr_slots - 1 - i;
+	t->nr_slots = t->nr_free = nr_slots;
+	t->user_data_base = user_data_base;
+	return 0;
+}
+
+void io_uring_zc_tracker_exit(struct io_uring_zc_tracker *t)
+{
+	uring_free(t->slots);
+	uring_free(t->free);
+	t->slots = NULL;
+	t->free = NULL;
+}
+
+/*
+ * Assign a free slot to the zero-copy send in 'sqe', by way of its user_data.
+ * Returns the slot index, or -EBUSY if all slots have sends in flight.
+ */
+int io_uring_zc_tracker_track(struct io_uring_zc_tracker *t,
+			      struct io_uring_sqe *sqe, void *data)
+{
+	struct io_uring_zc_slot *slot;
+	unsigned index;
+
+	if (!t->nr_free)
+		return -EBUSY;
+
+	index = t->free[--t->nr_free];
+	slot = &t->slots[index];
+	slot->data = data;
+	slot->res = 0;
+	slot->state = ZC_SLOT_BUSY;
+	io_uring_sqe_set_data64(sqe, t->user_data_base + index);
+	return index;
+}
+
+/*
+ * Feed a cqe to the tracker. Returns -ENOENT if it doesn't belong to a
+ * tracked send, 0 if the send still holds on to its buffer, and 1 once both
+ * cqes have been seen. In the latter case the send result and the data passed
+ * to io_uring_zc_tracker_track() are returned, and the slot is released.
+ */
+int io_uring_zc_tracker_cqe(struct io_uring_zc_tracker *t,
+			    const struct io_uring_cqe *cqe, int *res,
+			    void **data)
+{
+	struct io_uring_zc_slot *slot;
+	__u64 index = cqe->user_data - t->user_data_base;
+
+	if (cqe->user_data < t->user_data_base || index >= t->nr_slots)
+		return -ENOENT;
+	slot = &t->slots[index];
+	if (!(slot->state & ZC_SLOT_BUSY))
+		return -ENOENT;
+
+	if (cqe->flags & IORING_CQE_F_NOTIF) {
+		if (cqe->res & IORING_NOTIF_USAGE_ZC_COPIED)
+			t->nr_copied++;
+		slot->state |= ZC_SLOT_NOTIF;
+	} else {
+		slot->res = cqe->res;
+		slot->state |= ZC_SLOT_RESULT;
+		/* no notification follows if the buffer was never used */
+		if (!(cqe->flags & IORING_CQE_F_MORE))
+			slot->state |= ZC_SLOT_NOTIF;
+	}
+
+	if (!(slot->state & ZC_SLOT_RESULT) || !(slot->state & ZC_SLOT_NOTIF))
+		return 0;
+
+	*res = slot->res;
+	if (data)
+		*data = slot->data;
+	slot->state = 0;
+	t->free[t->nr_free++] = index;
+	return 1;
+}
@@ -0,0 +1,308 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test multishot accept, both into the normal file table and
+ *		into kernel allocated slots of the fixed file table.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "liburing.h"
+
+#define NR_CONNS	4
+#define NR_SLOTS	4
+
+static int no_accept_multishot;
+
+static int create_listener(struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (bind(fd, (struct sockaddr *) addr, sizeof(*addr)) < 0) {
+		perror("bind");
+		return -1;
+	}
+	if (getsockname(fd, (struct sockaddr *) addr, &len) < 0) {
+		perror("getsockname");
+		return -1;
+	}
+	if (listen(fd, 128) < 0) {
+		perror("listen");
+		return -1;
+	}
+	return fd;
+}
+
+static int connect_one(struct sockaddr_in *addr)
+{
+	int fd;
+
+	fd = socket(AF_INET, SOCK_STREAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	if (connect(fd, (struct sockaddr *) addr, sizeof(*addr)) < 0) {
+		perror("connect");
+		return -1;
+	}
+	return fd;
+}
+
+static int wait_accept(struct io_uring *ring, int *res, unsigned *flags)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return ret;
+	}
+	if (cqe->user_data != 1) {
+		fprintf(stderr, "unexpected user_data %llu\n",
+				(unsigned long long) cqe->user_data);
+		return -EINVAL;
+	}
+	*res = cqe->res;
+	*flags = cqe->flags;
+	io_uring_cqe_seen(ring, cqe);
+	return 0;
+}
+
+static int test_normal(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	struct sockaddr_in addr;
+	int lfd, cfds[NR_CONNS], i, ret, res;
+	unsigned flags;
+	char c;
+
+	lfd = create_listener(&addr);
+	if (lfd < 0)
+		return 1;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_multishot_accept(sqe, lfd, NULL, NULL, 0);
+	sqe->user_data = 1;
+	io_uring_submit(ring);
+
+	for (i = 0; i < NR_CONNS; i++) {
+		cfds[i] = connect_one(&addr);
+		if (cfds[i] < 0)
+			return 1;
+		if (wait_accept(ring, &res, &flags))
+			return 1;
+		if (res == -EINVAL && !i) {
+			no_accept_multishot = 1;
+			close(cfds[i]);
+			close(lfd);
+			return 0;
+		}
+		if (res < 0) {
+			fprintf(stderr, "accept %d: %d\n", i, res);
+			return 1;
+		}
+		if (!(flags & IORING_CQE_F_MORE)) {
+			fprintf(stderr, "accept %d: no F_MORE\n", i);
+			return 1;
+		}
+		/* check that we got the fd of this connection */
+		c = 'a' + i;
+		if (write(cfds[i], &c, 1) != 1 || read(res, &c, 1) != 1 ||
+		    c != 'a' + i) {
+			fprintf(stderr, "accept %d: data mismatch\n", i);
+			return 1;
+		}
+		close(res);
+	}
+
+	/* cancelling terminates the request, without F_MORE */
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cancel(sqe, 1, 0);
+	sqe->user_data = 2;
+	io_uring_submit(ring);
+
+	for (i = 0; i < 2; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data == 1 && (cqe->res != -ECANCELED ||
+		    (cqe->flags & IORING_CQE_F_MORE))) {
+			fprintf(stderr, "cancelled accept: %d, flags %x\n",
+					cqe->res, cqe->flags);
+			return 1;
+		} else if (cqe->user_data == 2 && cqe->res) {
+			fprintf(stderr, "cancel: %d\n", cqe->res);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+
+	for (i = 0; i < NR_CONNS; i++)
+		close(cfds[i]);
+	close(lfd);
+	return 0;
+}
+
+static int test_direct(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	struct sockaddr_in addr;
+	int lfd, cfds[NR_SLOTS + 1], files[NR_SLOTS];
+	int i, ret, res, seen = 0;
+	unsigned flags;
+
+	lfd = create_listener(&addr);
+	if (lfd < 0)
+		return 1;
+
+	for (i = 0; i < NR_SLOTS; i++)
+		files[i] = -1;
+	ret = io_uring_register_files(ring, files, NR_SLOTS);
+	if (ret) {
+		fprintf(stderr, "register files: %d\n", ret);
+		return 1;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_multishot_accept_direct(sqe, lfd, NULL, NULL, 0);
+	sqe->user_data = 1;
+	io_uring_submit(ring);
+
+	/* each connection gets its own slot, until the table is full */
+	for (i = 0; i < NR_SLOTS; i++) {
+		cfds[i] = connect_one(&addr);
+		if (cfds[i] < 0)
+			return 1;
+		if (wait_accept(ring, &res, &flags))
+			return 1;
+		if (res < 0 || res >= NR_SLOTS || (seen & (1 << res))) {
+			fprintf(stderr, "direct accept %d: %d\n", i, res);
+			return 1;
+		}
+		if (!(flags & IORING_CQE_F_MORE)) {
+			fprintf(stderr, "direct accept %d: no F_MORE\n", i);
+			return 1;
+		}
+		seen |= 1 << res;
+	}
+
+	/* no free slot left, which terminates the request */
+	cfds[i] = connect_one(&addr);
+	if (cfds[i] < 0)
+		return 1;
+	if (wait_accept(ring, &res, &flags))
+		return 1;
+	if (res != -ENFILE || (flags & IORING_CQE_F_MORE)) {
+		fprintf(stderr, "accept into full table: %d, flags %x\n",
+				res, flags);
+		return 1;
+	}
+
+	for (i = 0; i < NR_SLOTS + 1; i++)
+		close(cfds[i]);
+	close(lfd);
+	return io_uring_unregister_files(ring);
+}
+
+/* single shot accept into a kernel allocated slot */
+static int test_direct_alloc(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	struct sockaddr_in addr;
+	int lfd, cfd, files[NR_SLOTS];
+	int i, ret, res;
+	unsigned flags;
+
+	lfd = create_listener(&addr);
+	if (lfd < 0)
+		return 1;
+
+	for (i = 0; i < NR_SLOTS; i++)
+		files[i] = -1;
+	ret = io_uring_register_files(ring, files, NR_SLOTS);
+	if (ret) {
+		fprintf(stderr, "register files: %d\n", ret);
+		return 1;
+	}
+
+	cfd = connect_one(&addr);
+	if (cfd < 0)
+		return 1;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_accept_direct(sqe, lfd, NULL, NULL, 0,
+				    IORING_FILE_INDEX_ALLOC);
+	sqe->user_data = 1;
+	io_uring_submit(ring);
+
+	if (wait_accept(ring, &res, &flags))
+		return 1;
+	if (res < 0 || res >= NR_SLOTS || (flags & IORING_CQE_F_MORE)) {
+		fprintf(stderr, "alloc accept: %d, flags %x\n", res, flags);
+		return 1;
+	}
+
+	close(cfd);
+	close(lfd);
+	return io_uring_unregister_files(ring);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_normal(&ring);
+	if (ret) {
+		fprintf(stderr, "test_normal failed\n");
+		return ret;
+	}
+	if (no_accept_multishot) {
+		fprintf(stdout, "Multishot accept not supported, skipping\n");
+		return 0;
+	}
+
+	ret = test_direct(&ring);
+	if (ret) {
+		fprintf(stderr, "test_direct failed\n");
+		return ret;
+	}
+
+	ret = test_direct_alloc(&ring);
+	if (ret) {
+		fprintf(stderr, "test_direct_alloc failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
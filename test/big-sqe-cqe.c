@@ -0,0 +1,180 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test rings set up with IORING_SETUP_SQE128 and
+ *		IORING_SETUP_CQE32, checking sqe/cqe indexing through all the
+ *		library helpers across ring wraps.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+
+#define RING_SIZE	8
+#define BATCH		6
+#define NR_LOOPS	4
+
+static int queue_nops(struct io_uring *ring, unsigned base)
+{
+	struct io_uring_sqe *sqes[BATCH];
+	int i, ret;
+
+	if (io_uring_get_sqes(ring, sqes, BATCH) != BATCH) {
+		fprintf(stderr, "get sqes failed\n");
+		return 1;
+	}
+	for (i = 0; i < BATCH; i++) {
+		io_uring_prep_nop(sqes[i]);
+		if (ring->flags & IORING_SETUP_SQE128)
+			memset(io_uring_sqe_cmd(sqes[i]), 0x5a, 80);
+		sqes[i]->user_data = base + i;
+	}
+
+	ret = io_uring_submit(ring);
+	if (ret != BATCH) {
+		fprintf(stderr, "submit %d, wanted %d\n", ret, BATCH);
+		return 1;
+	}
+	return 0;
+}
+
+static int check_cqe(struct io_uring *ring, struct io_uring_cqe *cqe,
+		     unsigned data)
+{
+	if (cqe->user_data != data || cqe->res) {
+		fprintf(stderr, "bad cqe data %lu/%u, res %d\n",
+				(unsigned long) cqe->user_data, data, cqe->res);
+		return 1;
+	}
+	if ((ring->flags & IORING_SETUP_CQE32) &&
+	    (io_uring_cqe_big(cqe)[0] || io_uring_cqe_big(cqe)[1])) {
+		fprintf(stderr, "extra cqe data not zero\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int test_sqe_layout(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe1, *sqe2;
+	size_t expected = sizeof(struct io_uring_sqe);
+
+	if (ring->flags & IORING_SETUP_SQE128)
+		expected *= 2;
+
+	sqe1 = io_uring_get_sqe(ring);
+	sqe2 = io_uring_get_sqe(ring);
+	if ((char *) sqe2 - (char *) sqe1 != expected) {
+		fprintf(stderr, "sqe stride %ld, wanted %lu\n",
+				(long) ((char *) sqe2 - (char *) sqe1),
+				(unsigned long) expected);
+		return 1;
+	}
+	io_uring_prep_nop(sqe1);
+	io_uring_prep_nop(sqe2);
+	sqe1->user_data = sqe2->user_data = 0;
+	return 0;
+}
+
+static int test(unsigned flags)
+{
+	struct io_uring_cqe *cqes[BATCH], *cqe;
+	struct io_uring ring;
+	unsigned head, seen;
+	int ret, i, loop;
+
+	ret = io_uring_queue_init(RING_SIZE, &ring, flags);
+	if (ret == -EINVAL) {
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	if (test_sqe_layout(&ring))
+		return 1;
+	ret = io_uring_submit_and_wait(&ring, 2);
+	if (ret != 2) {
+		fprintf(stderr, "submit layout nops: %d\n", ret);
+		return 1;
+	}
+	io_uring_cq_advance(&ring, 2);
+
+	for (loop = 0; loop < NR_LOOPS; loop++) {
+		unsigned base = loop * BATCH;
+
+		if (queue_nops(&ring, base))
+			return 1;
+
+		/* alternate between the different ways of reaping */
+		switch (loop % 3) {
+		case 0:
+			for (i = 0; i < BATCH; i++) {
+				ret = io_uring_wait_cqe(&ring, &cqe);
+				if (ret) {
+					fprintf(stderr, "wait cqe %d\n", ret);
+					return 1;
+				}
+				if (check_cqe(&ring, cqe, base + i))
+					return 1;
+				io_uring_cqe_seen(&ring, cqe);
+			}
+			break;
+		case 1:
+			if (io_uring_peek_batch_cqe(&ring, cqes, BATCH) != BATCH) {
+				fprintf(stderr, "peek batch short\n");
+				return 1;
+			}
+			for (i = 0; i < BATCH; i++)
+				if (check_cqe(&ring, cqes[i], base + i))
+					return 1;
+			io_uring_cq_advance(&ring, BATCH);
+			break;
+		case 2:
+			seen = 0;
+			io_uring_for_each_cqe(&ring, head, cqe) {
+				if (check_cqe(&ring, cqe, base + seen))
+					return 1;
+				seen++;
+			}
+			if (seen != BATCH) {
+				fprintf(stderr, "for_each saw %u\n", seen);
+				return 1;
+			}
+			io_uring_cq_advance(&ring, seen);
+			break;
+		}
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned flags[] = { 0, IORING_SETUP_SQE128, IORING_SETUP_CQE32,
+			     IORING_SETUP_SQE128 | IORING_SETUP_CQE32 };
+	int i, ret;
+
+	if (argc > 1)
+		return 0;
+
+	for (i = 0; i < 4; i++) {
+		ret = test(flags[i]);
+		if (ret) {
+			fprintf(stderr, "test flags %x failed\n", flags[i]);
+			return ret;
+		}
+	}
+
+	if (io_uring_mlock_size(RING_SIZE, IORING_SETUP_SQE128 |
+				IORING_SETUP_CQE32) < 0) {
+		fprintf(stderr, "mlock size failed\n");
+		return 1;
+	}
+
+	return 0;
+}
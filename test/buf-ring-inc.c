@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test incrementally consumed ring provided buffers,
+ *		registered with IOU_PBUF_RING_INC.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+
+#define BGID		1
+#define NR_BUFS		2
+#define BUF_SIZE	1024
+#define MSG_SIZE	128
+
+static char bufs[NR_BUFS][BUF_SIZE];
+static int no_buf_ring_inc;
+
+static int read_one(struct io_uring *ring, int fd, int *bid, int *more)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_read(sqe, fd, NULL, BUF_SIZE, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BGID;
+	io_uring_submit(ring);
+
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return ret;
+	}
+	ret = cqe->res;
+	if (ret >= 0) {
+		if (!io_uring_cqe_has_buffer(cqe)) {
+			fprintf(stderr, "no buffer selected\n");
+			ret = -EINVAL;
+		}
+		*bid = io_uring_cqe_buf_id(cqe);
+		*more = io_uring_cqe_buf_more(cqe);
+	}
+	io_uring_cqe_seen(ring, cqe);
+	return ret;
+}
+
+static int fill(int fd, char c, int len)
+{
+	char buf[BUF_SIZE];
+
+	memset(buf, c, len);
+	if (write(fd, buf, len) != len) {
+		perror("write");
+		return 1;
+	}
+	return 0;
+}
+
+static int check(int bid, int offset, char c, int len)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		if (bufs[bid][offset + i] != c) {
+			fprintf(stderr, "bid %d offset %d: got %c, wanted %c\n",
+					bid, offset + i, bufs[bid][offset + i], c);
+			return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * Small reads should pack into the first buffer back to back, with
+ * IORING_CQE_F_BUF_MORE set until the last read that fills it.
+ */
+static int test_inc(struct io_uring *ring)
+{
+	struct io_uring_buf_ring *br;
+	int mask = io_uring_buf_ring_mask(NR_BUFS);
+	int fds[2], i, ret, bid, more, offset;
+
+	br = io_uring_setup_buf_ring(ring, NR_BUFS, BGID, IOU_PBUF_RING_INC,
+					&ret);
+	if (!br) {
+		if (ret == -EINVAL) {
+			no_buf_ring_inc = 1;
+			return 0;
+		}
+		fprintf(stderr, "setup buf ring: %d\n", ret);
+		return 1;
+	}
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	memset(bufs, 0, sizeof(bufs));
+	for (i = 0; i < NR_BUFS; i++)
+		io_uring_buf_ring_add(br, bufs[i], BUF_SIZE, i, mask, i);
+	io_uring_buf_ring_advance(br, NR_BUFS);
+
+	offset = 0;
+	for (i = 0; i < BUF_SIZE / MSG_SIZE; i++) {
+		if (fill(fds[1], 'a' + i, MSG_SIZE))
+			return 1;
+		ret = read_one(ring, fds[0], &bid, &more);
+		if (ret != MSG_SIZE) {
+			fprintf(stderr, "read %d: %d\n", i, ret);
+			return 1;
+		}
+		if (bid != 0) {
+			fprintf(stderr, "read %d got bid %d\n", i, bid);
+			return 1;
+		}
+		/* only the read that uses up the buffer clears BUF_MORE */
+		if (more != (i != BUF_SIZE / MSG_SIZE - 1)) {
+			fprintf(stderr, "read %d: more %d\n", i, more);
+			return 1;
+		}
+		if (check(bid, offset, 'a' + i, MSG_SIZE))
+			return 1;
+		offset += ret;
+	}
+
+	/* buffer 0 is used up, the next read moves on to buffer 1 */
+	if (fill(fds[1], 'x', MSG_SIZE))
+		return 1;
+	ret = read_one(ring, fds[0], &bid, &more);
+	if (ret != MSG_SIZE || bid != 1 || !more) {
+		fprintf(stderr, "read into next buffer: %d, bid %d, more %d\n",
+				ret, bid, more);
+		return 1;
+	}
+	if (check(1, 0, 'x', MSG_SIZE))
+		return 1;
+
+	/* a read bigger than what's left is capped at the remainder */
+	if (fill(fds[1], 'y', BUF_SIZE - MSG_SIZE / 2))
+		return 1;
+	ret = read_one(ring, fds[0], &bid, &more);
+	if (ret != BUF_SIZE - MSG_SIZE || bid != 1 || more) {
+		fprintf(stderr, "read remainder: %d, bid %d, more %d\n",
+				ret, bid, more);
+		return 1;
+	}
+	if (check(1, MSG_SIZE, 'y', BUF_SIZE - MSG_SIZE))
+		return 1;
+
+	/* recycle buffer 0, the leftover data goes there from the start */
+	io_uring_buf_ring_add(br, bufs[0], BUF_SIZE, 0, mask, 0);
+	io_uring_buf_ring_advance(br, 1);
+	ret = read_one(ring, fds[0], &bid, &more);
+	if (ret != MSG_SIZE / 2 || bid != 0 || !more) {
+		fprintf(stderr, "read recycled: %d, bid %d, more %d\n",
+				ret, bid, more);
+		return 1;
+	}
+	if (check(0, 0, 'y', MSG_SIZE / 2))
+		return 1;
+
+	close(fds[0]);
+	close(fds[1]);
+	return io_uring_free_buf_ring(ring, br, NR_BUFS, BGID);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_inc(&ring);
+	if (ret) {
+		fprintf(stderr, "test_inc failed\n");
+		return ret;
+	}
+	if (no_buf_ring_inc)
+		fprintf(stdout, "Incremental buffer rings not supported, skipping\n");
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
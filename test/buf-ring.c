@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test ring provided buffers, registered with
+ *		IORING_REGISTER_PBUF_RING and recycled by the application
+ *		without any sqes.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+
+#define BGID		1
+#define NR_BUFS		8
+#define BUF_SIZE	32
+
+static char bufs[NR_BUFS][BUF_SIZE];
+
+static int test_reg_unreg(struct io_uring *ring)
+{
+	struct io_uring_buf_reg reg = { };
+	struct io_uring_buf_ring *br;
+	void *ptr;
+	int ret;
+
+	if (posix_memalign(&ptr, 4096, 4096))
+		return 1;
+
+	/* must be a power of 2 */
+	reg.ring_addr = (unsigned long) ptr;
+	reg.ring_entries = 3;
+	reg.bgid = BGID;
+	ret = io_uring_register_buf_ring(ring, &reg, 0);
+	if (ret != -EINVAL) {
+		fprintf(stderr, "non power of 2 entries: %d\n", ret);
+		return 1;
+	}
+
+	reg.ring_entries = NR_BUFS;
+	ret = io_uring_register_buf_ring(ring, &reg, 0);
+	if (ret) {
+		fprintf(stderr, "register: %d\n", ret);
+		return 1;
+	}
+	ret = io_uring_register_buf_ring(ring, &reg, 0);
+	if (ret != -EEXIST) {
+		fprintf(stderr, "double register: %d\n", ret);
+		return 1;
+	}
+	ret = io_uring_unregister_buf_ring(ring, BGID);
+	if (ret) {
+		fprintf(stderr, "unregister: %d\n", ret);
+		return 1;
+	}
+	ret = io_uring_unregister_buf_ring(ring, BGID);
+	if (ret != -EINVAL && ret != -ENOENT) {
+		fprintf(stderr, "double unregister: %d\n", ret);
+		return 1;
+	}
+	free(ptr);
+
+	br = io_uring_setup_buf_ring(ring, NR_BUFS, BGID, 0, &ret);
+	if (!br) {
+		fprintf(stderr, "setup buf ring: %d\n", ret);
+		return 1;
+	}
+	return io_uring_free_buf_ring(ring, br, NR_BUFS, BGID);
+}
+
+static int read_one(struct io_uring *ring, int fd, int *bid)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_read(sqe, fd, NULL, BUF_SIZE, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BGID;
+	io_uring_submit(ring);
+
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return ret;
+	}
+	ret = cqe->res;
+	if (ret >= 0) {
+		if (!(cqe->flags & IORING_CQE_F_BUFFER)) {
+			fprintf(stderr, "no buffer selected\n");
+			return -EINVAL;
+		}
+		*bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+	}
+	/* leave the cqe for the caller to advance past with the buffer */
+	return ret;
+}
+
+static int test_recycle(struct io_uring *ring)
+{
+	struct io_uring_buf_ring *br;
+	int mask = io_uring_buf_ring_mask(NR_BUFS);
+	int fds[2], i, ret, bid;
+	char c;
+
+	br = io_uring_setup_buf_ring(ring, NR_BUFS, BGID, 0, &ret);
+	if (!br) {
+		if (ret == -EINVAL) {
+			fprintf(stdout, "Buffer rings not supported, skipping\n");
+			return 0;
+		}
+		fprintf(stderr, "setup buf ring: %d\n", ret);
+		return 1;
+	}
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	for (i = 0; i < NR_BUFS; i++)
+		io_uring_buf_ring_add(br, bufs[i], BUF_SIZE, i, mask, i);
+	io_uring_buf_ring_advance(br, NR_BUFS);
+
+	/* go around the ring a few times, recycling each buffer */
+	for (i = 0; i < 4 * NR_BUFS; i++) {
+		c = 'a' + (i % 26);
+		if (write(fds[1], &c, 1) != 1) {
+			perror("write");
+			return 1;
+		}
+		ret = read_one(ring, fds[0], &bid);
+		if (ret != 1) {
+			fprintf(stderr, "read %d: %d\n", i, ret);
+			return 1;
+		}
+		if (bid != i % NR_BUFS || bufs[bid][0] != c) {
+			fprintf(stderr, "read %d got bid %d, data %c\n", i,
+					bid, bufs[bid][0]);
+			return 1;
+		}
+		io_uring_buf_ring_add(br, bufs[bid], BUF_SIZE, bid, mask, 0);
+		io_uring_buf_ring_cq_advance(ring, br, 1);
+	}
+
+	/* with no buffers handed back, the group runs dry */
+	for (i = 0; i < NR_BUFS; i++) {
+		if (write(fds[1], "x", 1) != 1) {
+			perror("write");
+			return 1;
+		}
+		ret = read_one(ring, fds[0], &bid);
+		io_uring_cq_advance(ring, 1);
+		if (ret != 1) {
+			fprintf(stderr, "read %d: %d\n", i, ret);
+			return 1;
+		}
+	}
+	if (write(fds[1], "x", 1) != 1) {
+		perror("write");
+		return 1;
+	}
+	ret = read_one(ring, fds[0], &bid);
+	io_uring_cq_advance(ring, 1);
+	if (ret != -ENOBUFS) {
+		fprintf(stderr, "read with no buffers: %d\n", ret);
+		return 1;
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+	return io_uring_free_buf_ring(ring, br, NR_BUFS, BGID);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_recycle(&ring);
+	if (ret) {
+		fprintf(stderr, "test_recycle failed\n");
+		return ret;
+	}
+
+	ret = test_reg_unreg(&ring);
+	if (ret) {
+		fprintf(stderr, "test_reg_unreg failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
@@ -0,0 +1,326 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test bulk cancelation, by fd, any and all matching requests,
+ *		both through IORING_OP_ASYNC_CANCEL and synchronously through
+ *		io_uring_register_sync_cancel().
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liburing.h"
+
+#define NR_READS	8
+#define CANCEL_DATA	0x1000
+
+static int no_cancel_flags;
+static int no_sync_cancel;
+static char buf[NR_READS][16];
+
+/* queue 'nr' reads on the empty pipe 'fd', with user_data from 'base' */
+static int queue_reads(struct io_uring *ring, int fd, int nr, int base,
+		       int fixed)
+{
+	struct io_uring_sqe *sqe;
+	int i, ret;
+
+	for (i = 0; i < nr; i++) {
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_read(sqe, fd, buf[i], sizeof(buf[i]), 0);
+		if (fixed)
+			sqe->flags |= IOSQE_FIXED_FILE;
+		sqe->user_data = base + i;
+	}
+	ret = io_uring_submit(ring);
+	if (ret != nr) {
+		fprintf(stderr, "submit reads: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Reap 'nr' canceled reads with user_data in [base, base + span), and the
+ * result of the cancel request into 'cancel_res' if it's set.
+ */
+static int reap(struct io_uring *ring, int nr, int base, int span,
+		int *cancel_res)
+{
+	struct io_uring_cqe *cqe;
+	int i, ret, seen = 0;
+
+	for (i = 0; i < nr + !!cancel_res; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data == CANCEL_DATA && cancel_res) {
+			*cancel_res = cqe->res;
+		} else if (cqe->user_data < (__u64) base ||
+			   cqe->user_data >= (__u64) (base + span) ||
+			   (cqe->res != -ECANCELED && cqe->res != -EINTR)) {
+			fprintf(stderr, "unexpected cqe %llu: %d\n",
+				(unsigned long long) cqe->user_data, cqe->res);
+			return 1;
+		} else {
+			seen++;
+		}
+		io_uring_cqe_seen(ring, cqe);
+		if (cancel_res && *cancel_res == -EINVAL)
+			return 0;
+	}
+	if (seen != nr) {
+		fprintf(stderr, "canceled %d reads, wanted %d\n", seen, nr);
+		return 1;
+	}
+	return 0;
+}
+
+static int submit_cancel(struct io_uring *ring, struct io_uring_sqe *sqe)
+{
+	int ret;
+
+	sqe->user_data = CANCEL_DATA;
+	ret = io_uring_submit(ring);
+	if (ret != 1) {
+		fprintf(stderr, "submit cancel: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_fd_all(struct io_uring *ring, int fd1, int fd2)
+{
+	struct io_uring_sqe *sqe;
+	int ret, res = 0;
+
+	if (queue_reads(ring, fd1, NR_READS / 2, 0, 0) ||
+	    queue_reads(ring, fd2, NR_READS / 2, NR_READS, 0))
+		return 1;
+
+	/* one cancel takes out all reads on fd1, but none on fd2 */
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cancel_fd(sqe, fd1, IORING_ASYNC_CANCEL_ALL);
+	if (submit_cancel(ring, sqe))
+		return 1;
+	ret = reap(ring, NR_READS / 2, 0, NR_READS / 2, &res);
+	if (ret)
+		return ret;
+	if (res == -EINVAL) {
+		no_cancel_flags = 1;
+		return 0;
+	}
+	if (res != NR_READS / 2) {
+		fprintf(stderr, "cancel fd all: %d\n", res);
+		return 1;
+	}
+
+	/* and one more takes out everything left */
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cancel(sqe, 0,
+			IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL);
+	if (submit_cancel(ring, sqe))
+		return 1;
+	ret = reap(ring, NR_READS / 2, NR_READS, NR_READS / 2, &res);
+	if (ret)
+		return ret;
+	if (res != NR_READS / 2) {
+		fprintf(stderr, "cancel any all: %d\n", res);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_fd_single(struct io_uring *ring, int fd)
+{
+	struct io_uring_sqe *sqe;
+	int ret, res = 0;
+
+	if (queue_reads(ring, fd, 2, 0, 0))
+		return 1;
+
+	/* without IORING_ASYNC_CANCEL_ALL, only the first match goes */
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cancel_fd(sqe, fd, 0);
+	if (submit_cancel(ring, sqe))
+		return 1;
+	ret = reap(ring, 1, 0, 2, &res);
+	if (ret)
+		return ret;
+	if (res) {
+		fprintf(stderr, "cancel fd: %d\n", res);
+		return 1;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cancel_fd(sqe, fd, 0);
+	if (submit_cancel(ring, sqe))
+		return 1;
+	ret = reap(ring, 1, 0, 2, &res);
+	if (ret)
+		return ret;
+	if (res) {
+		fprintf(stderr, "cancel fd second: %d\n", res);
+		return 1;
+	}
+
+	/* nothing left to match */
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cancel_fd(sqe, fd, 0);
+	if (submit_cancel(ring, sqe))
+		return 1;
+	ret = reap(ring, 0, 0, 0, &res);
+	if (ret)
+		return ret;
+	if (res != -ENOENT) {
+		fprintf(stderr, "cancel fd with no match: %d\n", res);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_fd_fixed(struct io_uring *ring, int fd)
+{
+	struct io_uring_sqe *sqe;
+	int ret, res = 0;
+
+	ret = io_uring_register_files(ring, &fd, 1);
+	if (ret) {
+		fprintf(stderr, "register files: %d\n", ret);
+		return 1;
+	}
+
+	if (queue_reads(ring, 0, NR_READS, 0, 1))
+		return 1;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cancel_fd(sqe, 0, IORING_ASYNC_CANCEL_ALL |
+				IORING_ASYNC_CANCEL_FD_FIXED);
+	if (submit_cancel(ring, sqe))
+		return 1;
+	ret = reap(ring, NR_READS, 0, NR_READS, &res);
+	if (ret)
+		return ret;
+	if (res != NR_READS) {
+		fprintf(stderr, "cancel fixed fd all: %d\n", res);
+		return 1;
+	}
+
+	io_uring_unregister_files(ring);
+	return 0;
+}
+
+static int test_sync(struct io_uring *ring, int fd1, int fd2)
+{
+	struct io_uring_sync_cancel_reg reg;
+	int ret;
+
+	if (queue_reads(ring, fd1, NR_READS / 2, 0, 0) ||
+	    queue_reads(ring, fd2, NR_READS / 2, NR_READS, 0))
+		return 1;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.fd = fd1;
+	reg.flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+	reg.timeout.tv_sec = -1;
+	reg.timeout.tv_nsec = -1;
+	ret = io_uring_register_sync_cancel(ring, &reg);
+	if (ret == -EINVAL) {
+		no_sync_cancel = 1;
+		return 0;
+	} else if (ret != NR_READS / 2) {
+		fprintf(stderr, "sync cancel fd: %d\n", ret);
+		return 1;
+	}
+	/* the canceled requests have completed by the time we get here */
+	if (io_uring_cq_ready(ring) != NR_READS / 2) {
+		fprintf(stderr, "sync cancel left %u cqes\n",
+				io_uring_cq_ready(ring));
+		return 1;
+	}
+	ret = reap(ring, NR_READS / 2, 0, NR_READS / 2, NULL);
+	if (ret)
+		return ret;
+
+	memset(&reg, 0, sizeof(reg));
+	reg.flags = IORING_ASYNC_CANCEL_ANY | IORING_ASYNC_CANCEL_ALL;
+	reg.timeout.tv_sec = -1;
+	reg.timeout.tv_nsec = -1;
+	ret = io_uring_register_sync_cancel(ring, &reg);
+	if (ret != NR_READS / 2) {
+		fprintf(stderr, "sync cancel any: %d\n", ret);
+		return 1;
+	}
+	ret = reap(ring, NR_READS / 2, NR_READS, NR_READS / 2, NULL);
+	if (ret)
+		return ret;
+
+	/* nothing left to match */
+	memset(&reg, 0, sizeof(reg));
+	reg.fd = fd1;
+	reg.flags = IORING_ASYNC_CANCEL_FD;
+	reg.timeout.tv_sec = -1;
+	reg.timeout.tv_nsec = -1;
+	ret = io_uring_register_sync_cancel(ring, &reg);
+	if (ret != -ENOENT) {
+		fprintf(stderr, "sync cancel with no match: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int p1[2], p2[2];
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(32, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+	if (pipe(p1) < 0 || pipe(p2) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	ret = test_fd_all(&ring, p1[0], p2[0]);
+	if (ret) {
+		fprintf(stderr, "test_fd_all failed\n");
+		return ret;
+	}
+	if (no_cancel_flags) {
+		fprintf(stdout, "Cancel flags not supported, skipping\n");
+		return 0;
+	}
+
+	ret = test_fd_single(&ring, p1[0]);
+	if (ret) {
+		fprintf(stderr, "test_fd_single failed\n");
+		return ret;
+	}
+
+	ret = test_fd_fixed(&ring, p1[0]);
+	if (ret) {
+		fprintf(stderr, "test_fd_fixed failed\n");
+		return ret;
+	}
+
+	ret = test_sync(&ring, p1[0], p2[0]);
+	if (ret) {
+		fprintf(stderr, "test_sync failed\n");
+		return ret;
+	}
+	if (no_sync_cancel)
+		fprintf(stdout, "Sync cancel not supported, skipping\n");
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
@@ -0,0 +1,265 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test sparse registered buffer tables, and cloning the
+ *		registered buffers of one ring into another.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "liburing.h"
+
+#define NR_BUFS		4
+#define BUF_SIZE	4096
+
+static char bufs[NR_BUFS][BUF_SIZE];
+static int no_clone;
+
+static int write_fixed(struct io_uring *ring, int fd, int index,
+		       const char *buf)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_write_fixed(sqe, fd, buf, 64, 0, index);
+	io_uring_submit(ring);
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return ret;
+	}
+	ret = cqe->res;
+	io_uring_cqe_seen(ring, cqe);
+	return ret;
+}
+
+/*
+ * Write from registered buffer 'index' of 'ring' into a pipe, and check that
+ * the contents of 'expect' came out.
+ */
+static int check_buf(struct io_uring *ring, int index, const char *expect)
+{
+	char out[BUF_SIZE];
+	int fds[2], ret;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+	ret = write_fixed(ring, fds[1], index, expect);
+	if (ret != 64) {
+		fprintf(stderr, "write_fixed from %d: %d\n", index, ret);
+		return 1;
+	}
+	if (read(fds[0], out, 64) != 64 || memcmp(out, expect, 64)) {
+		fprintf(stderr, "buffer %d: data mismatch\n", index);
+		return 1;
+	}
+	close(fds[0]);
+	close(fds[1]);
+	return 0;
+}
+
+static int test_clone(struct io_uring *src, struct io_uring *dst)
+{
+	int ret;
+
+	ret = io_uring_clone_buffers(dst, src);
+	if (ret == -EINVAL) {
+		no_clone = 1;
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "clone: %d\n", ret);
+		return 1;
+	}
+	if (check_buf(dst, 2, bufs[2]))
+		return 1;
+
+	/* the destination has a table now */
+	ret = io_uring_clone_buffers(dst, src);
+	if (ret != -EBUSY) {
+		fprintf(stderr, "clone into existing table: %d\n", ret);
+		return 1;
+	}
+	ret = io_uring_clone_buffers_offset(dst, src, 0, 0, 0,
+					    IORING_REGISTER_DST_REPLACE);
+	if (ret) {
+		fprintf(stderr, "clone with replace: %d\n", ret);
+		return 1;
+	}
+	return check_buf(dst, 3, bufs[3]);
+}
+
+struct clone_data {
+	struct io_uring *src;
+	struct io_uring *dst;
+};
+
+static void *clone_thread(void *arg)
+{
+	struct clone_data *cd = arg;
+	int ret;
+
+	ret = io_uring_clone_buffers(cd->dst, cd->src);
+	if (ret) {
+		fprintf(stderr, "clone from thread: %d\n", ret);
+		return (void *) 1;
+	}
+	if (check_buf(cd->dst, 1, bufs[1]))
+		return (void *) 1;
+
+	/* SRC_REGISTERED from the caller must not leak through either */
+	ret = io_uring_clone_buffers_offset(cd->dst, cd->src, 0, 0, 0,
+					    IORING_REGISTER_DST_REPLACE |
+					    IORING_REGISTER_SRC_REGISTERED);
+	if (ret) {
+		fprintf(stderr, "clone with src registered flag: %d\n", ret);
+		return (void *) 1;
+	}
+	if (check_buf(cd->dst, 0, bufs[0]))
+		return (void *) 1;
+	return NULL;
+}
+
+/*
+ * Registered ring fds are per thread, so a source ring registered by one
+ * thread must still be cloneable from another, as a ring per thread setup
+ * would do.
+ */
+static int test_thread_clone(struct io_uring *src, struct io_uring *dst)
+{
+	struct clone_data cd = { .src = src, .dst = dst };
+	pthread_t thread;
+	void *tret;
+	int ret;
+
+	ret = io_uring_register_ring_fd(src);
+	if (ret == -EINVAL) {
+		fprintf(stdout, "Registered ring fd not supported, skipping\n");
+		return 0;
+	} else if (ret != 1) {
+		fprintf(stderr, "register ring fd: %d\n", ret);
+		return 1;
+	}
+
+	pthread_create(&thread, NULL, clone_thread, &cd);
+	pthread_join(thread, &tret);
+
+	ret = io_uring_unregister_ring_fd(src);
+	if (ret != 1) {
+		fprintf(stderr, "unregister ring fd: %d\n", ret);
+		return 1;
+	}
+	return tret != NULL;
+}
+
+static int test_sparse(struct io_uring *src, struct io_uring *dst)
+{
+	struct iovec iov;
+	int ret;
+
+	ret = io_uring_register_buffers_sparse(dst, 2 * NR_BUFS);
+	if (ret) {
+		fprintf(stderr, "register sparse: %d\n", ret);
+		return 1;
+	}
+
+	/* empty slots can't be used */
+	ret = write_fixed(dst, STDOUT_FILENO, 0, bufs[0]);
+	if (ret != -EFAULT) {
+		fprintf(stderr, "write from empty slot: %d\n", ret);
+		return 1;
+	}
+
+	/* src buffers 1 and 2 into slots 4 and 5 */
+	ret = io_uring_clone_buffers_offset(dst, src, 4, 1, 2,
+					    IORING_REGISTER_DST_REPLACE);
+	if (ret) {
+		fprintf(stderr, "clone with offsets: %d\n", ret);
+		return 1;
+	}
+	if (check_buf(dst, 4, bufs[1]) || check_buf(dst, 5, bufs[2]))
+		return 1;
+
+	/* fill in an empty slot in place */
+	iov.iov_base = bufs[0];
+	iov.iov_len = BUF_SIZE;
+	ret = io_uring_register_buffers_update_tag(dst, 0, &iov, NULL, 1);
+	if (ret != 1) {
+		fprintf(stderr, "update sparse slot: %d\n", ret);
+		return 1;
+	}
+	if (check_buf(dst, 0, bufs[0]))
+		return 1;
+
+	/* cloned buffers outlive the source table */
+	ret = io_uring_unregister_buffers(src);
+	if (ret) {
+		fprintf(stderr, "unregister source: %d\n", ret);
+		return 1;
+	}
+	return check_buf(dst, 5, bufs[2]);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring src, dst, dst2, dst3;
+	struct iovec iovs[NR_BUFS];
+	int i, ret;
+
+	if (argc > 1)
+		return 0;
+
+	if (io_uring_queue_init(8, &src, 0) ||
+	    io_uring_queue_init(8, &dst, 0) ||
+	    io_uring_queue_init(8, &dst2, 0) ||
+	    io_uring_queue_init(8, &dst3, 0)) {
+		fprintf(stderr, "ring setup failed\n");
+		return 1;
+	}
+
+	for (i = 0; i < NR_BUFS; i++) {
+		memset(bufs[i], 'a' + i, BUF_SIZE);
+		iovs[i].iov_base = bufs[i];
+		iovs[i].iov_len = BUF_SIZE;
+	}
+	ret = io_uring_register_buffers(&src, iovs, NR_BUFS);
+	if (ret) {
+		fprintf(stderr, "register buffers: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_clone(&src, &dst);
+	if (ret) {
+		fprintf(stderr, "test_clone failed\n");
+		return ret;
+	}
+	if (no_clone) {
+		fprintf(stdout, "Buffer cloning not supported, skipping\n");
+		return 0;
+	}
+
+	ret = test_thread_clone(&src, &dst3);
+	if (ret) {
+		fprintf(stderr, "test_thread_clone failed\n");
+		return ret;
+	}
+
+	ret = test_sparse(&src, &dst2);
+	if (ret) {
+		fprintf(stderr, "test_sparse failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&dst3);
+	io_uring_queue_exit(&dst2);
+	io_uring_queue_exit(&dst);
+	io_uring_queue_exit(&src);
+	return 0;
+}
@@ -0,0 +1,142 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test IORING_SETUP_COOP_TASKRUN and IORING_SETUP_TASKRUN_FLAG,
+ *		checking that pending task work is flagged through
+ *		IORING_SQ_TASKRUN and that the peek helpers enter the kernel
+ *		to run it.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+
+static int test_flag(struct io_uring *ring, int batch)
+{
+	struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	char buf, data = 'x';
+	int fds[2], ret;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_read(sqe, fds[0], &buf, 1, 0);
+	sqe->user_data = 1;
+	ret = io_uring_submit(ring);
+	if (ret != 1) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return 1;
+	}
+
+	if (IO_URING_READ_ONCE(*ring->sq.kflags) & IORING_SQ_TASKRUN) {
+		fprintf(stderr, "taskrun flagged with nothing pending\n");
+		return 1;
+	}
+
+	/*
+	 * The read completes through task work, which isn't forced to run
+	 * while we're in userspace.
+	 */
+	if (write(fds[1], &data, 1) != 1) {
+		perror("write");
+		return 1;
+	}
+
+	if (io_uring_cq_ready(ring)) {
+		/* ran on the write syscall exit, nothing to test */
+		goto reap;
+	}
+	if (!(IO_URING_READ_ONCE(*ring->sq.kflags) & IORING_SQ_TASKRUN)) {
+		fprintf(stderr, "pending task work not flagged\n");
+		return 1;
+	}
+
+	if (batch) {
+		struct io_uring_cqe *cqes[1];
+
+		if (io_uring_peek_batch_cqe(ring, cqes, 1) != 1) {
+			fprintf(stderr, "peek batch missed completion\n");
+			return 1;
+		}
+	}
+reap:
+	ret = io_uring_peek_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "peek cqe: %d\n", ret);
+		return 1;
+	}
+	if (cqe->res != 1 || cqe->user_data != 1) {
+		fprintf(stderr, "bad cqe res %d, data %lu\n", cqe->res,
+				(unsigned long) cqe->user_data);
+		return 1;
+	}
+	io_uring_cqe_seen(ring, cqe);
+
+	if (IO_URING_READ_ONCE(*ring->sq.kflags) & IORING_SQ_TASKRUN) {
+		fprintf(stderr, "taskrun flag not cleared\n");
+		return 1;
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+	return 0;
+}
+
+static int test(unsigned flags)
+{
+	struct io_uring ring;
+	int ret;
+
+	ret = io_uring_queue_init(8, &ring, flags);
+	if (ret == -EINVAL) {
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_flag(&ring, 0);
+	if (ret) {
+		fprintf(stderr, "test_flag peek failed\n");
+		return ret;
+	}
+
+	ret = test_flag(&ring, 1);
+	if (ret) {
+		fprintf(stderr, "test_flag batch failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = test(IORING_SETUP_COOP_TASKRUN | IORING_SETUP_TASKRUN_FLAG);
+	if (ret) {
+		fprintf(stderr, "test coop taskrun failed\n");
+		return ret;
+	}
+
+	ret = test(IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN |
+		   IORING_SETUP_TASKRUN_FLAG);
+	if (ret) {
+		fprintf(stderr, "test defer taskrun failed\n");
+		return ret;
+	}
+
+	return 0;
+}
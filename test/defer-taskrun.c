@@ -0,0 +1,221 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test rings set up with IORING_SETUP_SINGLE_ISSUER and
+ *		IORING_SETUP_DEFER_TASKRUN, where completions are only posted
+ *		to the CQ ring once the kernel is entered for events. Checks
+ *		that the peek helpers make deferred completions visible.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "liburing.h"
+
+#define NR_READS	4
+
+static int queue_reads(struct io_uring *ring, int *fds, char *buf)
+{
+	struct io_uring_sqe *sqe;
+	int i, ret;
+
+	for (i = 0; i < NR_READS; i++) {
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_read(sqe, fds[0], &buf[i], 1, 0);
+		sqe->user_data = i + 1;
+	}
+
+	ret = io_uring_submit(ring);
+	if (ret != NR_READS) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+static int write_pipe(int *fds, int nr)
+{
+	char data[NR_READS];
+
+	memset(data, 'x', sizeof(data));
+	if (write(fds[1], data, nr) != nr) {
+		perror("write");
+		return 1;
+	}
+	return 0;
+}
+
+static int test_peek(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+	char buf[NR_READS];
+	int fds[2], ret, i;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	if (queue_reads(ring, fds, buf))
+		return 1;
+
+	ret = io_uring_peek_cqe(ring, &cqe);
+	if (ret != -EAGAIN) {
+		fprintf(stderr, "peek with nothing pending: %d\n", ret);
+		return 1;
+	}
+
+	/*
+	 * One read completes via deferred task work, which the kernel won't
+	 * run until we ask for events. The peek must find it.
+	 */
+	if (write_pipe(fds, 1))
+		return 1;
+	if (io_uring_cq_ready(ring)) {
+		fprintf(stderr, "completion posted without entering\n");
+		return 1;
+	}
+	ret = io_uring_peek_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "peek deferred completion: %d\n", ret);
+		return 1;
+	}
+	if (cqe->res != 1) {
+		fprintf(stderr, "cqe res %d\n", cqe->res);
+		return 1;
+	}
+	io_uring_cqe_seen(ring, cqe);
+
+	/* complete and reap the rest */
+	if (write_pipe(fds, NR_READS - 1))
+		return 1;
+	for (i = 1; i < NR_READS; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+
+	close(fds[1]);
+	close(fds[0]);
+	return 0;
+}
+
+static int test_peek_batch(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqes[NR_READS];
+	char buf[NR_READS];
+	int fds[2];
+	unsigned got;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	if (queue_reads(ring, fds, buf))
+		return 1;
+
+	got = io_uring_peek_batch_cqe(ring, cqes, NR_READS);
+	if (got) {
+		fprintf(stderr, "peek batch with nothing pending: %u\n", got);
+		return 1;
+	}
+
+	if (write_pipe(fds, NR_READS))
+		return 1;
+	got = io_uring_peek_batch_cqe(ring, cqes, NR_READS);
+	if (!got) {
+		fprintf(stderr, "peek batch missed deferred completions\n");
+		return 1;
+	}
+	io_uring_cq_advance(ring, got);
+
+	/* pick up any stragglers the kernel hadn't completed yet */
+	while (got < NR_READS) {
+		struct io_uring_cqe *cqe;
+
+		if (io_uring_wait_cqe(ring, &cqe)) {
+			fprintf(stderr, "wait cqe failed\n");
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+		got++;
+	}
+
+	close(fds[1]);
+	close(fds[0]);
+	return 0;
+}
+
+static void *submit_thread(void *data)
+{
+	struct io_uring *ring = data;
+	struct io_uring_sqe *sqe;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_nop(sqe);
+	return (void *) (intptr_t) io_uring_submit(ring);
+}
+
+static int test_single_issuer(struct io_uring *ring)
+{
+	pthread_t thread;
+	void *tret;
+
+	pthread_create(&thread, NULL, submit_thread, ring);
+	pthread_join(thread, &tret);
+
+	if ((intptr_t) tret != -EEXIST) {
+		fprintf(stderr, "submit from other task: %d\n",
+				(int) (intptr_t) tret);
+		return 1;
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(8, &ring, IORING_SETUP_SINGLE_ISSUER |
+					    IORING_SETUP_DEFER_TASKRUN);
+	if (ret == -EINVAL) {
+		fprintf(stdout, "DEFER_TASKRUN not supported, skipping\n");
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_peek(&ring);
+	if (ret) {
+		fprintf(stderr, "test_peek failed\n");
+		return ret;
+	}
+
+	ret = test_peek_batch(&ring);
+	if (ret) {
+		fprintf(stderr, "test_peek_batch failed\n");
+		return ret;
+	}
+
+	ret = test_single_issuer(&ring);
+	if (ret) {
+		fprintf(stderr, "test_single_issuer failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
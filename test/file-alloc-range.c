@@ -0,0 +1,209 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test registering a sparse file table, and restricting the
+ *		slots the kernel allocates direct descriptors from.
+ *
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "liburing.h"
+
+#define RANGE_OFF	100
+#define RANGE_LEN	4
+
+static int no_alloc_range;
+static unsigned nr_files;
+
+static int submit_wait(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	io_uring_submit(ring);
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return ret;
+	}
+	ret = cqe->res;
+	io_uring_cqe_seen(ring, cqe);
+	return ret;
+}
+
+static int open_alloc(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+	io_uring_prep_openat_direct(sqe, AT_FDCWD, "/dev/null", O_RDONLY, 0,
+				    IORING_FILE_INDEX_ALLOC);
+	return submit_wait(ring);
+}
+
+static int close_slot(struct io_uring *ring, unsigned slot)
+{
+	struct io_uring_sqe *sqe = io_uring_get_sqe(ring);
+
+	io_uring_prep_close_direct(sqe, slot);
+	return submit_wait(ring);
+}
+
+/* a big sparse table needs no fds, but may need the rlimit raised */
+static int register_sparse(struct io_uring *ring, unsigned *nr)
+{
+	int ret;
+
+	*nr = 1U << 20;
+	ret = io_uring_register_files_sparse(ring, *nr);
+	if (ret == -EMFILE) {
+		*nr = 1U << 14;
+		ret = io_uring_register_files_sparse(ring, *nr);
+	}
+	return ret;
+}
+
+static int test_sparse(struct io_uring *ring)
+{
+	unsigned nr;
+	int ret, fd;
+
+	ret = register_sparse(ring, &nr);
+	nr_files = nr;
+	if (ret == -EINVAL) {
+		no_alloc_range = 1;
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "register sparse: %d\n", ret);
+		return 1;
+	}
+
+	/* without a range, allocation starts at the bottom of the table */
+	ret = open_alloc(ring);
+	if (ret != 0) {
+		fprintf(stderr, "alloc without range: %d\n", ret);
+		return 1;
+	}
+	/* and the last slot is usable as any other */
+	fd = open("/dev/null", O_RDONLY);
+	ret = io_uring_register_files_update(ring, nr - 1, &fd, 1);
+	close(fd);
+	if (ret != 1) {
+		fprintf(stderr, "update last slot: %d\n", ret);
+		return 1;
+	}
+	ret = close_slot(ring, nr - 1);
+	if (ret) {
+		fprintf(stderr, "close last slot: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_range(struct io_uring *ring)
+{
+	int i, ret, slots = 0;
+
+	ret = io_uring_register_file_alloc_range(ring, RANGE_OFF, RANGE_LEN);
+	if (ret == -EINVAL) {
+		no_alloc_range = 1;
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "register alloc range: %d\n", ret);
+		return 1;
+	}
+
+	for (i = 0; i < RANGE_LEN; i++) {
+		ret = open_alloc(ring);
+		if (ret < RANGE_OFF || ret >= RANGE_OFF + RANGE_LEN ||
+		    (slots & (1 << (ret - RANGE_OFF)))) {
+			fprintf(stderr, "alloc %d: %d\n", i, ret);
+			return 1;
+		}
+		slots |= 1 << (ret - RANGE_OFF);
+	}
+
+	/* the range is full, even if the rest of the table isn't */
+	ret = open_alloc(ring);
+	if (ret != -ENFILE) {
+		fprintf(stderr, "alloc from full range: %d\n", ret);
+		return 1;
+	}
+
+	/* a freed slot in the range gets handed out again */
+	ret = close_slot(ring, RANGE_OFF + 2);
+	if (ret) {
+		fprintf(stderr, "close: %d\n", ret);
+		return 1;
+	}
+	ret = open_alloc(ring);
+	if (ret != RANGE_OFF + 2) {
+		fprintf(stderr, "alloc after close: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_bad_range(struct io_uring *ring)
+{
+	int ret;
+
+	ret = io_uring_register_file_alloc_range(ring, nr_files - 2, 4);
+	if (ret != -EINVAL) {
+		fprintf(stderr, "range past the table: %d\n", ret);
+		return 1;
+	}
+	ret = io_uring_register_file_alloc_range(ring, ~0U - 1, 4);
+	if (ret != -EOVERFLOW) {
+		fprintf(stderr, "wrapping range: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_sparse(&ring);
+	if (ret) {
+		fprintf(stderr, "test_sparse failed\n");
+		return ret;
+	}
+	if (no_alloc_range)
+		goto skip;
+
+	ret = test_range(&ring);
+	if (ret) {
+		fprintf(stderr, "test_range failed\n");
+		return ret;
+	}
+	if (no_alloc_range)
+		goto skip;
+
+	ret = test_bad_range(&ring);
+	if (ret) {
+		fprintf(stderr, "test_bad_range failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+skip:
+	fprintf(stdout, "Sparse tables or alloc ranges not supported, skipping\n");
+	io_uring_queue_exit(&ring);
+	return 0;
+}
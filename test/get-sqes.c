@@ -0,0 +1,149 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test bulk sqe reservation with io_uring_get_sqes(), including
+ *		runs that wrap around the end of the SQ ring.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+
+#define RING_SIZE	8
+
+static int submit_and_reap(struct io_uring *ring, struct io_uring_sqe **sqes,
+			   unsigned nr, unsigned offset)
+{
+	struct io_uring_cqe *cqe;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < nr; i++) {
+		io_uring_prep_nop(sqes[i]);
+		sqes[i]->user_data = offset + i;
+	}
+
+	ret = io_uring_submit(ring);
+	if (ret != nr) {
+		fprintf(stderr, "submitted %d, wanted %u\n", ret, nr);
+		return 1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data != offset + i) {
+			fprintf(stderr, "got user_data %lu, wanted %u\n",
+					(unsigned long) cqe->user_data,
+					offset + i);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+
+	return 0;
+}
+
+static int test_partial(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqes[RING_SIZE];
+	unsigned got;
+
+	got = io_uring_get_sqes(ring, sqes, 5);
+	if (got != 5) {
+		fprintf(stderr, "got %u sqes, wanted 5\n", got);
+		return 1;
+	}
+
+	/* only 3 left, all-or-nothing should fail and reserve nothing */
+	got = io_uring_get_sqes(ring, &sqes[5], 4);
+	if (got) {
+		fprintf(stderr, "got %u sqes, wanted 0\n", got);
+		return 1;
+	}
+	if (io_uring_sq_space_left(ring) != 3) {
+		fprintf(stderr, "space left %u\n",
+				io_uring_sq_space_left(ring));
+		return 1;
+	}
+
+	got = io_uring_get_sqes(ring, &sqes[5], 3);
+	if (got != 3) {
+		fprintf(stderr, "got %u sqes, wanted 3\n", got);
+		return 1;
+	}
+	if (io_uring_get_sqe(ring)) {
+		fprintf(stderr, "got sqe from full ring\n");
+		return 1;
+	}
+
+	return submit_and_reap(ring, sqes, RING_SIZE, 0);
+}
+
+static int test_wrap(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqes[RING_SIZE];
+	unsigned i, j;
+
+	if (io_uring_get_sqes(ring, sqes, 3) != 3)
+		return 1;
+	if (submit_and_reap(ring, sqes, 3, 100))
+		return 1;
+
+	/* a full ring's worth now starts at index 3 and wraps */
+	if (io_uring_get_sqes(ring, sqes, RING_SIZE) != RING_SIZE) {
+		fprintf(stderr, "wrapped reservation failed\n");
+		return 1;
+	}
+	if (sqes[0] != &ring->sq.sqes[3] || sqes[RING_SIZE - 1] !=
+	    &ring->sq.sqes[2]) {
+		fprintf(stderr, "unexpected wrapped sqe layout\n");
+		return 1;
+	}
+	for (i = 0; i < RING_SIZE; i++) {
+		for (j = i + 1; j < RING_SIZE; j++) {
+			if (sqes[i] == sqes[j]) {
+				fprintf(stderr, "duplicate sqe %u/%u\n", i, j);
+				return 1;
+			}
+		}
+	}
+
+	return submit_and_reap(ring, sqes, RING_SIZE, 200);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(RING_SIZE, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_partial(&ring);
+	if (ret) {
+		fprintf(stderr, "test_partial failed\n");
+		return ret;
+	}
+
+	ret = test_wrap(&ring);
+	if (ret) {
+		fprintf(stderr, "test_wrap failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
@@ -0,0 +1,425 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the MSG_RING based mailbox, passing messages from one
+ *		ring to another with batching, backpressure and failed sends.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "liburing.h"
+
+#define MB_ID		7
+#define CAPACITY	4
+#define NR_THREAD_MSGS	100000
+
+static int no_mailbox;
+
+static int probe_flags_pass(struct io_uring *src, struct io_uring *dst)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	sqe = io_uring_get_sqe(src);
+	io_uring_prep_msg_ring_cqe_flags(sqe, dst->ring_fd, 0, 0, 0, 0);
+	io_uring_submit(src);
+	ret = io_uring_wait_cqe(src, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return 1;
+	}
+	if (cqe->res == -EINVAL || cqe->res == -EBADFD)
+		no_mailbox = 1;
+	else if (cqe->res) {
+		fprintf(stderr, "msg_ring: %d\n", cqe->res);
+		return 1;
+	}
+	io_uring_cqe_seen(src, cqe);
+	if (no_mailbox)
+		return 0;
+
+	ret = io_uring_wait_cqe(dst, &cqe);
+	if (ret)
+		return 1;
+	io_uring_cqe_seen(dst, cqe);
+	return 0;
+}
+
+static int test_init(struct io_uring *src, struct io_uring *dst)
+{
+	struct io_uring_mailbox mb;
+	int ret;
+
+	ret = io_uring_mailbox_init(&mb, src, dst, 0, CAPACITY);
+	if (ret != -EINVAL) {
+		fprintf(stderr, "init with id 0: %d\n", ret);
+		return 1;
+	}
+	ret = io_uring_mailbox_init(&mb, src, dst, MB_ID,
+				    *dst->cq.kring_entries + 1);
+	if (ret != -EINVAL) {
+		fprintf(stderr, "init larger than the CQ ring: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_send(struct io_uring *src, struct io_uring *dst)
+{
+	struct io_uring_mailbox mb;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int i, ret, obj;
+
+	ret = io_uring_mailbox_init(&mb, src, dst, MB_ID, CAPACITY);
+	if (ret) {
+		fprintf(stderr, "init: %d\n", ret);
+		return 1;
+	}
+
+	/* a completion of the receiver's own isn't a message */
+	sqe = io_uring_get_sqe(dst);
+	io_uring_prep_nop(sqe);
+	sqe->user_data = 1;
+	io_uring_submit(dst);
+
+	for (i = 0; i < CAPACITY - 1; i++) {
+		ret = io_uring_mailbox_send(&mb, 100 + i);
+		if (ret) {
+			fprintf(stderr, "send %d: %d\n", i, ret);
+			return 1;
+		}
+	}
+	ret = io_uring_mailbox_send(&mb, (__u64) (uintptr_t) &obj);
+	if (ret) {
+		fprintf(stderr, "send pointer: %d\n", ret);
+		return 1;
+	}
+
+	/* messages are batched until flushed */
+	if (io_uring_cq_ready(dst) != 1) {
+		fprintf(stderr, "messages before flush: %u\n",
+				io_uring_cq_ready(dst));
+		return 1;
+	}
+
+	/* the receiver hasn't acked anything, so this must push back */
+	ret = io_uring_mailbox_send(&mb, 200);
+	if (ret != -EAGAIN) {
+		fprintf(stderr, "send over capacity: %d\n", ret);
+		return 1;
+	}
+
+	ret = io_uring_mailbox_flush(&mb);
+	if (ret != CAPACITY) {
+		fprintf(stderr, "flush: %d\n", ret);
+		return 1;
+	}
+
+	for (i = 0; i < CAPACITY + 1; i++) {
+		ret = io_uring_wait_cqe(dst, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data == 1) {
+			if (io_uring_mailbox_is_msg(&mb, cqe)) {
+				fprintf(stderr, "nop taken as a message\n");
+				return 1;
+			}
+			io_uring_cqe_seen(dst, cqe);
+			continue;
+		}
+		if (!io_uring_mailbox_is_msg(&mb, cqe)) {
+			fprintf(stderr, "not a message: %d, flags %x\n",
+					cqe->res, cqe->flags);
+			return 1;
+		}
+		io_uring_cqe_seen(dst, cqe);
+	}
+
+	/* successful sends post nothing on the sending ring */
+	if (io_uring_cq_ready(src)) {
+		fprintf(stderr, "cqes on the sending ring: %u\n",
+				io_uring_cq_ready(src));
+		return 1;
+	}
+
+	/* acking makes room again */
+	io_uring_mailbox_ack(&mb, 2);
+	for (i = 0; i < 3; i++) {
+		ret = io_uring_mailbox_send(&mb, 300 + i);
+		if (ret != (i < 2 ? 0 : -EAGAIN)) {
+			fprintf(stderr, "send after ack %d: %d\n", i, ret);
+			return 1;
+		}
+	}
+	io_uring_mailbox_flush(&mb);
+	for (i = 0; i < 2; i++) {
+		ret = io_uring_wait_cqe(dst, &cqe);
+		if (ret || !io_uring_mailbox_is_msg(&mb, cqe) ||
+		    cqe->user_data != (__u64) (300 + i)) {
+			fprintf(stderr, "message after ack %d: %d\n", i, ret);
+			return 1;
+		}
+		io_uring_cqe_seen(dst, cqe);
+	}
+	return 0;
+}
+
+static int test_order(struct io_uring *src, struct io_uring *dst)
+{
+	struct io_uring_mailbox mb;
+	struct io_uring_cqe *cqe;
+	int i, ret, obj;
+
+	ret = io_uring_mailbox_init(&mb, src, dst, MB_ID, CAPACITY);
+	if (ret)
+		return 1;
+	for (i = 0; i < CAPACITY - 1; i++)
+		io_uring_mailbox_send(&mb, 100 + i);
+	io_uring_mailbox_send(&mb, (__u64) (uintptr_t) &obj);
+	io_uring_mailbox_flush(&mb);
+
+	for (i = 0; i < CAPACITY; i++) {
+		ret = io_uring_wait_cqe(dst, &cqe);
+		if (ret)
+			return 1;
+		if (i < CAPACITY - 1 && cqe->user_data != (__u64) (100 + i)) {
+			fprintf(stderr, "message %d: %llu\n", i,
+					(unsigned long long) cqe->user_data);
+			return 1;
+		} else if (i == CAPACITY - 1 &&
+			   (int *) (uintptr_t) cqe->user_data != &obj) {
+			fprintf(stderr, "pointer message mismatch\n");
+			return 1;
+		}
+		io_uring_cqe_seen(dst, cqe);
+	}
+	return 0;
+}
+
+/*
+ * Reap 'nr' cqes on the sending ring, which must all be failed sends on 'mb'.
+ */
+static int reap_failed(struct io_uring_mailbox *mb, struct io_uring *src,
+		       int nr)
+{
+	struct io_uring_cqe *cqe;
+	int i, ret;
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_wait_cqe(src, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (!io_uring_mailbox_failed(mb, cqe) || cqe->res >= 0) {
+			fprintf(stderr, "not a failed send: %d, data %llu\n",
+					cqe->res,
+					(unsigned long long) cqe->user_data);
+			return 1;
+		}
+		io_uring_cqe_seen(src, cqe);
+	}
+	return 0;
+}
+
+/*
+ * Sends to a ring that has gone away fail, and must give their credit back
+ * rather than shrinking the mailbox for good.
+ */
+static int test_failed(struct io_uring *src)
+{
+	struct io_uring_mailbox mb;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	struct io_uring dst;
+	int i, ret;
+
+	ret = io_uring_queue_init(8, &dst, 0);
+	if (ret)
+		return 1;
+	ret = io_uring_mailbox_init(&mb, src, &dst, MB_ID, CAPACITY);
+	if (ret) {
+		fprintf(stderr, "init: %d\n", ret);
+		return 1;
+	}
+	io_uring_queue_exit(&dst);
+
+	/* the sender's own completions aren't failed sends */
+	sqe = io_uring_get_sqe(src);
+	io_uring_prep_nop(sqe);
+	sqe->user_data = 1;
+	io_uring_submit(src);
+	ret = io_uring_wait_cqe(src, &cqe);
+	if (ret || io_uring_mailbox_failed(&mb, cqe)) {
+		fprintf(stderr, "nop taken as a failed send\n");
+		return 1;
+	}
+	io_uring_cqe_seen(src, cqe);
+	if (mb.failed) {
+		fprintf(stderr, "failed count after nop: %u\n", mb.failed);
+		return 1;
+	}
+
+	for (i = 0; i < CAPACITY; i++) {
+		ret = io_uring_mailbox_send(&mb, 100 + i);
+		if (ret) {
+			fprintf(stderr, "send %d: %d\n", i, ret);
+			return 1;
+		}
+	}
+	io_uring_mailbox_flush(&mb);
+	if (reap_failed(&mb, src, CAPACITY))
+		return 1;
+
+	/* nothing was acked, but the failures made room again */
+	for (i = 0; i < CAPACITY; i++) {
+		ret = io_uring_mailbox_send(&mb, 200 + i);
+		if (ret) {
+			fprintf(stderr, "send after failure %d: %d\n", i, ret);
+			return 1;
+		}
+	}
+	io_uring_mailbox_flush(&mb);
+	return reap_failed(&mb, src, CAPACITY);
+}
+
+struct thread_data {
+	struct io_uring *src;
+	struct io_uring_mailbox *mb;
+};
+
+static void *sender(void *arg)
+{
+	struct thread_data *td = arg;
+	__u64 i;
+	int ret;
+
+	for (i = 1; i <= NR_THREAD_MSGS; i++) {
+		while ((ret = io_uring_mailbox_send(td->mb, i)) == -EAGAIN) {
+			io_uring_mailbox_flush(td->mb);
+			sched_yield();
+		}
+		if (ret) {
+			fprintf(stderr, "thread send: %d\n", ret);
+			return (void *) 1;
+		}
+	}
+	io_uring_mailbox_flush(td->mb);
+	return NULL;
+}
+
+static int test_threads(struct io_uring *dst)
+{
+	struct io_uring_mailbox mb;
+	struct io_uring_cqe *cqe;
+	struct thread_data td;
+	struct io_uring src;
+	pthread_t thread;
+	__u64 expect = 1;
+	unsigned head, nr;
+	void *tret;
+	int ret;
+
+	ret = io_uring_queue_init(32, &src, 0);
+	if (ret)
+		return 1;
+	ret = io_uring_mailbox_init(&mb, &src, dst, MB_ID, 16);
+	if (ret)
+		return 1;
+	td.src = &src;
+	td.mb = &mb;
+	pthread_create(&thread, NULL, sender, &td);
+
+	while (expect <= NR_THREAD_MSGS) {
+		ret = io_uring_wait_cqe(dst, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		nr = 0;
+		io_uring_for_each_cqe(dst, head, cqe) {
+			if (!io_uring_mailbox_is_msg(&mb, cqe) ||
+			    cqe->user_data != expect) {
+				fprintf(stderr, "thread message %llu, wanted "
+					"%llu\n", (unsigned long long)
+					cqe->user_data,
+					(unsigned long long) expect);
+				return 1;
+			}
+			expect++;
+			nr++;
+		}
+		io_uring_cq_advance(dst, nr);
+		io_uring_mailbox_ack(&mb, nr);
+	}
+
+	pthread_join(thread, &tret);
+	io_uring_queue_exit(&src);
+	return tret != NULL;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring src, dst;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	if (io_uring_queue_init(8, &src, 0) ||
+	    io_uring_queue_init(8, &dst, 0)) {
+		fprintf(stderr, "ring setup failed\n");
+		return 1;
+	}
+
+	ret = probe_flags_pass(&src, &dst);
+	if (ret)
+		return ret;
+	if (no_mailbox) {
+		fprintf(stdout, "MSG_RING flags passing not supported, skipping\n");
+		return 0;
+	}
+
+	ret = test_init(&src, &dst);
+	if (ret) {
+		fprintf(stderr, "test_init failed\n");
+		return ret;
+	}
+
+	ret = test_send(&src, &dst);
+	if (ret) {
+		fprintf(stderr, "test_send failed\n");
+		return ret;
+	}
+
+	ret = test_order(&src, &dst);
+	if (ret) {
+		fprintf(stderr, "test_order failed\n");
+		return ret;
+	}
+
+	ret = test_failed(&src);
+	if (ret) {
+		fprintf(stderr, "test_failed failed\n");
+		return ret;
+	}
+
+	ret = test_threads(&dst);
+	if (ret) {
+		fprintf(stderr, "test_threads failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&src);
+	io_uring_queue_exit(&dst);
+	return 0;
+}
@@ -0,0 +1,200 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test io_uring_submit_and_wait_min_timeout(), waiting for a
+ *		full batch for a short while, and then for any completion.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "liburing.h"
+
+#define MIN_WAIT_USEC	50000
+#define BATCH		4
+
+static unsigned long long mtime_since(const struct timeval *s,
+				      const struct timeval *e)
+{
+	long long sec, usec;
+
+	sec = e->tv_sec - s->tv_sec;
+	usec = (e->tv_usec - s->tv_usec);
+	if (sec > 0 && usec < 0) {
+		sec--;
+		usec += 1000000;
+	}
+
+	sec *= 1000;
+	usec /= 1000;
+	return sec + usec;
+}
+
+static unsigned long long mtime_since_now(struct timeval *tv)
+{
+	struct timeval end;
+
+	gettimeofday(&end, NULL);
+	return mtime_since(tv, &end);
+}
+
+static void reap(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+
+	while (!io_uring_peek_cqe(ring, &cqe))
+		io_uring_cqe_seen(ring, cqe);
+}
+
+/*
+ * One request completes after 10 msec, the rest much later. After the min
+ * wait expires, we should get the one that completed rather than wait for
+ * the overall timeout.
+ */
+static int test_partial(struct io_uring *ring)
+{
+	struct __kernel_timespec ts = { .tv_sec = 1, };
+	struct __kernel_timespec short_ts = { .tv_nsec = 10000000, };
+	struct __kernel_timespec long_ts = { .tv_sec = 5, };
+	struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	unsigned long long msec;
+	struct timeval tv;
+	int ret;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_timeout(sqe, &short_ts, 0, 0);
+	sqe->user_data = 1;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_timeout(sqe, &long_ts, 0, 0);
+	sqe->user_data = 2;
+
+	gettimeofday(&tv, NULL);
+	ret = io_uring_submit_and_wait_min_timeout(ring, &cqe, BATCH, &ts,
+						   MIN_WAIT_USEC, NULL);
+	msec = mtime_since_now(&tv);
+	if (ret) {
+		fprintf(stderr, "submit and wait: %d\n", ret);
+		return 1;
+	}
+	if (cqe->user_data != 1) {
+		fprintf(stderr, "got user_data %lu\n",
+				(unsigned long) cqe->user_data);
+		return 1;
+	}
+	if (io_uring_cq_ready(ring) != 1) {
+		fprintf(stderr, "%u ready\n", io_uring_cq_ready(ring));
+		return 1;
+	}
+	if (msec >= 500) {
+		fprintf(stderr, "waited %llu msec for partial batch\n", msec);
+		return 1;
+	}
+	io_uring_cqe_seen(ring, cqe);
+
+	/* cancel the long timeout */
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_timeout_remove(sqe, 2, 0);
+	sqe->user_data = 3;
+	ret = io_uring_submit_and_wait(ring, 2);
+	if (ret != 1) {
+		fprintf(stderr, "timeout remove: %d\n", ret);
+		return 1;
+	}
+	reap(ring);
+	return 0;
+}
+
+/* a full batch returns right away */
+static int test_full(struct io_uring *ring)
+{
+	struct __kernel_timespec ts = { .tv_sec = 1, };
+	struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	int i, ret;
+
+	for (i = 0; i < BATCH; i++) {
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_nop(sqe);
+	}
+
+	ret = io_uring_submit_and_wait_min_timeout(ring, &cqe, BATCH, &ts,
+						   MIN_WAIT_USEC, NULL);
+	if (ret) {
+		fprintf(stderr, "submit and wait: %d\n", ret);
+		return 1;
+	}
+	if (io_uring_cq_ready(ring) != BATCH) {
+		fprintf(stderr, "%u ready\n", io_uring_cq_ready(ring));
+		return 1;
+	}
+	reap(ring);
+	return 0;
+}
+
+/* with nothing completing, the overall timeout still applies */
+static int test_timeout(struct io_uring *ring)
+{
+	struct __kernel_timespec ts = { .tv_nsec = 100000000, };
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	ret = io_uring_submit_and_wait_min_timeout(ring, &cqe, BATCH, &ts,
+						   MIN_WAIT_USEC, NULL);
+	if (ret != -ETIME) {
+		fprintf(stderr, "wait with nothing pending: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+	if (!(ring.features & IORING_FEAT_MIN_TIMEOUT)) {
+		struct io_uring_cqe *cqe;
+
+		ret = io_uring_submit_and_wait_min_timeout(&ring, &cqe, 1, NULL,
+							   MIN_WAIT_USEC, NULL);
+		if (ret != -EINVAL) {
+			fprintf(stderr, "min wait without support: %d\n", ret);
+			return 1;
+		}
+		fprintf(stdout, "Min timeout not supported, skipping\n");
+		return 0;
+	}
+
+	ret = test_partial(&ring);
+	if (ret) {
+		fprintf(stderr, "test_partial failed\n");
+		return ret;
+	}
+
+	ret = test_full(&ring);
+	if (ret) {
+		fprintf(stderr, "test_full failed\n");
+		return ret;
+	}
+
+	ret = test_timeout(&ring);
+	if (ret) {
+		fprintf(stderr, "test_timeout failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
@@ -0,0 +1,236 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test the multi-producer submission front-end, with several
+ *		threads getting and committing sqes while one thread submits
+ *		them and reaps the completions.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "liburing.h"
+
+#define RING_SIZE	32
+#define NR_THREADS	4
+#define NR_PER_THREAD	10000
+
+struct producer {
+	struct io_uring_mpsc *q;
+	pthread_t thread;
+	unsigned long id;
+};
+
+static void *producer_fn(void *data)
+{
+	struct producer *p = data;
+	struct io_uring_sqe *sqe;
+	unsigned long i;
+
+	for (i = 0; i < NR_PER_THREAD; i++) {
+		while ((sqe = io_uring_mpsc_get_sqe(p->q)) == NULL)
+			sched_yield();
+		io_uring_prep_nop(sqe);
+		sqe->user_data = (p->id << 32) | i;
+		io_uring_mpsc_commit(p->q, sqe);
+	}
+	return NULL;
+}
+
+static int test_threads(struct io_uring *ring)
+{
+	struct producer producers[NR_THREADS];
+	unsigned next[NR_THREADS];
+	struct io_uring_mpsc q;
+	unsigned long done = 0, total = NR_THREADS * NR_PER_THREAD;
+	int i, ret;
+
+	ret = io_uring_mpsc_init(&q, ring);
+	if (ret) {
+		fprintf(stderr, "mpsc init: %d\n", ret);
+		return 1;
+	}
+
+	memset(next, 0, sizeof(next));
+	for (i = 0; i < NR_THREADS; i++) {
+		producers[i].q = &q;
+		producers[i].id = i;
+		pthread_create(&producers[i].thread, NULL, producer_fn,
+				&producers[i]);
+	}
+
+	while (done < total) {
+		struct io_uring_cqe *cqe;
+		unsigned head, seen = 0;
+
+		ret = io_uring_mpsc_submit(&q);
+		if (ret < 0) {
+			fprintf(stderr, "submit: %d\n", ret);
+			return 1;
+		}
+
+		io_uring_for_each_cqe(ring, head, cqe) {
+			unsigned id = cqe->user_data >> 32;
+			unsigned nr = cqe->user_data & 0xffffffff;
+
+			/* nops from one producer complete in order */
+			if (id >= NR_THREADS || nr != next[id]) {
+				fprintf(stderr, "bad cqe %u/%u, expected %u\n",
+						id, nr,
+						id < NR_THREADS ? next[id] : 0);
+				return 1;
+			}
+			next[id]++;
+			seen++;
+		}
+		io_uring_cq_advance(ring, seen);
+		done += seen;
+		if (!seen && !ret)
+			sched_yield();
+	}
+
+	for (i = 0; i < NR_THREADS; i++)
+		pthread_join(producers[i].thread, NULL);
+
+	if (io_uring_mpsc_flush(&q) || io_uring_sq_ready(ring)) {
+		fprintf(stderr, "sqes left over\n");
+		return 1;
+	}
+
+	io_uring_mpsc_exit(&q);
+	return 0;
+}
+
+/* slots are only handed out once the kernel has consumed them */
+static int test_full(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqes[RING_SIZE], *sqe;
+	struct io_uring_mpsc q;
+	int i, ret;
+
+	ret = io_uring_mpsc_init(&q, ring);
+	if (ret) {
+		fprintf(stderr, "mpsc init: %d\n", ret);
+		return 1;
+	}
+
+	for (i = 0; i < RING_SIZE; i++) {
+		sqes[i] = io_uring_mpsc_get_sqe(&q);
+		if (!sqes[i]) {
+			fprintf(stderr, "get sqe %d failed\n", i);
+			return 1;
+		}
+		io_uring_prep_nop(sqes[i]);
+	}
+	if (io_uring_mpsc_get_sqe(&q)) {
+		fprintf(stderr, "got sqe from full ring\n");
+		return 1;
+	}
+
+	/* an uncommitted sqe ends the run that gets flushed */
+	for (i = 0; i < RING_SIZE; i++) {
+		if (i != 4)
+			io_uring_mpsc_commit(&q, sqes[i]);
+	}
+	if (io_uring_mpsc_flush(&q) != 4) {
+		fprintf(stderr, "flushed past uncommitted sqe\n");
+		return 1;
+	}
+	io_uring_mpsc_commit(&q, sqes[4]);
+	ret = io_uring_mpsc_submit(&q);
+	if (ret != RING_SIZE) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return 1;
+	}
+
+	sqe = io_uring_mpsc_get_sqe(&q);
+	if (!sqe) {
+		fprintf(stderr, "no sqe after submit\n");
+		return 1;
+	}
+	io_uring_prep_nop(sqe);
+	io_uring_mpsc_commit(&q, sqe);
+	ret = io_uring_mpsc_submit(&q);
+	if (ret != 1) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return 1;
+	}
+
+	for (i = 0; i < RING_SIZE + 1; i++) {
+		struct io_uring_cqe *cqe;
+
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+
+	io_uring_mpsc_exit(&q);
+	return 0;
+}
+
+static int test(unsigned flags)
+{
+	struct io_uring_params p = { };
+	struct io_uring ring;
+	int ret;
+
+	p.flags = flags | IORING_SETUP_CQSIZE;
+	p.cq_entries = 4 * RING_SIZE;
+	ret = io_uring_queue_init_params(RING_SIZE, &ring, &p);
+	if (ret == -EINVAL)
+		return 0;
+	else if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_full(&ring);
+	if (ret) {
+		fprintf(stderr, "test_full failed\n");
+		return ret;
+	}
+
+	ret = test_threads(&ring);
+	if (ret) {
+		fprintf(stderr, "test_threads failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = test(0);
+	if (ret) {
+		fprintf(stderr, "test default failed\n");
+		return ret;
+	}
+
+	ret = test(IORING_SETUP_SQE128);
+	if (ret) {
+		fprintf(stderr, "test sqe128 failed\n");
+		return ret;
+	}
+
+	ret = test(IORING_SETUP_NO_SQARRAY);
+	if (ret) {
+		fprintf(stderr, "test no sqarray failed\n");
+		return ret;
+	}
+
+	return 0;
+}
@@ -0,0 +1,195 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test rings set up with IORING_SETUP_NO_MMAP, both with memory
+ *		allocated by liburing and with several rings carved out of a
+ *		single application provided buffer.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "liburing.h"
+
+#define NR_RINGS	4
+#define HUGE_SIZE	(2 * 1024 * 1024UL)
+
+static int do_nops(struct io_uring *ring, int nr)
+{
+	struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	int i, ret;
+
+	for (i = 0; i < nr; i++) {
+		sqe = io_uring_get_sqe(ring);
+		if (!sqe) {
+			fprintf(stderr, "get sqe failed\n");
+			return 1;
+		}
+		io_uring_prep_nop(sqe);
+		sqe->user_data = i + 1;
+	}
+
+	ret = io_uring_submit(ring);
+	if (ret != nr) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return 1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data != i + 1 || cqe->res) {
+			fprintf(stderr, "bad cqe data %lu, res %d\n",
+					(unsigned long) cqe->user_data,
+					cqe->res);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+
+	return 0;
+}
+
+/*
+ * Rings bigger than a page are allocated with huge pages, so 'entries'
+ * decides which path of the library allocator gets tested.
+ */
+static int test_lib_mem(unsigned entries, unsigned flags)
+{
+	struct io_uring_params p = { };
+	struct io_uring ring;
+	int ret;
+
+	p.flags = IORING_SETUP_NO_MMAP | flags;
+	ret = io_uring_queue_init_params(entries, &ring, &p);
+	if (ret == -EINVAL) {
+		fprintf(stdout, "NO_MMAP not supported, skipping\n");
+		return 0;
+	} else if (ret == -ENOMEM) {
+		fprintf(stdout, "No huge pages for %u entries, skipping\n",
+				entries);
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	/* more than a ring's worth, to wrap the SQ and CQ rings */
+	ret = do_nops(&ring, entries);
+	if (!ret)
+		ret = do_nops(&ring, entries / 2 + 1);
+	if (!ret)
+		ret = do_nops(&ring, entries);
+
+	io_uring_queue_exit(&ring);
+	return ret;
+}
+
+static int test_app_mem(void)
+{
+	struct io_uring rings[NR_RINGS], short_ring;
+	struct io_uring_params p;
+	size_t used = 0;
+	void *buf;
+	int i, ret, nr = 0;
+
+	buf = mmap(NULL, HUGE_SIZE, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+	if (buf == MAP_FAILED) {
+		/* no huge pages, small rings still fit in single pages */
+		buf = mmap(NULL, HUGE_SIZE, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (buf == MAP_FAILED) {
+			perror("mmap");
+			return 1;
+		}
+	}
+
+	ret = 0;
+	for (i = 0; i < NR_RINGS; i++) {
+		memset(&p, 0, sizeof(p));
+		ret = io_uring_queue_init_mem(8, &rings[i], &p, buf + used,
+						HUGE_SIZE - used);
+		if (ret == -EINVAL && !i) {
+			fprintf(stdout, "NO_MMAP not supported, skipping\n");
+			ret = 0;
+			goto out;
+		} else if (ret < 0) {
+			fprintf(stderr, "ring %d setup failed: %d\n", i, ret);
+			ret = 1;
+			goto out;
+		}
+		if (!ret || ret % sysconf(_SC_PAGESIZE)) {
+			fprintf(stderr, "bad size used: %d\n", ret);
+			ret = 1;
+			goto out;
+		}
+		used += ret;
+		nr++;
+	}
+
+	ret = 0;
+	for (i = 0; i < nr; i++) {
+		ret = do_nops(&rings[i], 4);
+		if (ret)
+			goto out;
+	}
+
+	memset(&p, 0, sizeof(p));
+	p.flags = IORING_SETUP_NO_MMAP;
+	ret = io_uring_queue_init_mem(8, &short_ring, &p, buf + used, 1);
+	if (ret != -ENOMEM) {
+		fprintf(stderr, "short buffer setup: %d\n", ret);
+		if (ret >= 0)
+			io_uring_queue_exit(&short_ring);
+		ret = 1;
+		goto out;
+	}
+	ret = 0;
+out:
+	for (i = 0; i < nr; i++)
+		io_uring_queue_exit(&rings[i]);
+	munmap(buf, HUGE_SIZE);
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = test_lib_mem(8, 0);
+	if (ret) {
+		fprintf(stderr, "test_lib_mem failed\n");
+		return ret;
+	}
+
+	ret = test_lib_mem(8, IORING_SETUP_SQE128 | IORING_SETUP_CQE32);
+	if (ret) {
+		fprintf(stderr, "test_lib_mem big failed\n");
+		return ret;
+	}
+
+	ret = test_lib_mem(256, 0);
+	if (ret) {
+		fprintf(stderr, "test_lib_mem huge failed\n");
+		return ret;
+	}
+
+	ret = test_app_mem();
+	if (ret) {
+		fprintf(stderr, "test_app_mem failed\n");
+		return ret;
+	}
+
+	return 0;
+}
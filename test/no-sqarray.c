@@ -0,0 +1,92 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test rings set up with IORING_SETUP_NO_SQARRAY, ensuring
+ *		that submissions work across SQ ring wraps without the
+ *		SQ index array.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+
+#define RING_SIZE	8
+#define NR_LOOPS	5
+
+static int test_nops(struct io_uring *ring, int nr, int loop)
+{
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int i, ret;
+
+	for (i = 0; i < nr; i++) {
+		sqe = io_uring_get_sqe(ring);
+		if (!sqe) {
+			fprintf(stderr, "get sqe failed\n");
+			return 1;
+		}
+		io_uring_prep_nop(sqe);
+		sqe->user_data = loop * RING_SIZE + i;
+	}
+
+	ret = io_uring_submit(ring);
+	if (ret != nr) {
+		fprintf(stderr, "submitted %d, wanted %d\n", ret, nr);
+		return 1;
+	}
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data != loop * RING_SIZE + i) {
+			fprintf(stderr, "got user_data %lu, wanted %d\n",
+					(unsigned long) cqe->user_data,
+					loop * RING_SIZE + i);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret, i;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(RING_SIZE, &ring, IORING_SETUP_NO_SQARRAY);
+	if (ret == -EINVAL) {
+		fprintf(stdout, "NO_SQARRAY not supported, skipping\n");
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	if (ring.sq.array) {
+		fprintf(stderr, "SQ array mapped\n");
+		return 1;
+	}
+
+	/* odd sized batches, so we wrap the SQ ring at varying offsets */
+	for (i = 0; i < NR_LOOPS; i++) {
+		ret = test_nops(&ring, 3 + i, i);
+		if (ret) {
+			fprintf(stderr, "test_nops failed loop %d\n", i);
+			return ret;
+		}
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
@@ -8,6 +8,13 @@
 #include <stdlib.h>
 #include <string.h>
 #include <fcntl.h>
+#include <stddef.h>
+#include <sys/prctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <linux/filter.h>
+#include <linux/seccomp.h>
 
 #include "helpers.h"
 #include "liburing.h"
@@ -102,6 +109,187 @@ err:
 	return 1;
 }
 
+/* make io_uring_setup(2) return 'action' from now on, as seccomp would */
+static int block_setup(unsigned action)
+{
+	struct sock_filter filter[] = {
+		BPF_STMT(BPF_LD | BPF_W | BPF_ABS,
+			 offsetof(struct seccomp_data, nr)),
+		BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, __NR_io_uring_setup, 0, 1),
+		BPF_STMT(BPF_RET | BPF_K, action),
+		BPF_STMT(BPF_RET | BPF_K, SECCOMP_RET_ALLOW),
+	};
+	struct sock_fprog prog = {
+		.len = sizeof(filter) / sizeof(filter[0]),
+		.filter = filter,
+	};
+
+	if (prctl(PR_SET_NO_NEW_PRIVS, 1, 0, 0, 0) ||
+	    prctl(PR_SET_SECCOMP, SECCOMP_MODE_FILTER, &prog))
+		return 1;
+	return 0;
+}
+
+/*
+ * With io_uring blocked, the empty table must be kept rather than probed for
+ * again on every call. Runs in a child, as filters can't be removed and the
+ * table is per process. Once the empty table is in, a second filter kills
+ * the child if io_uring_setup(2) is tried again.
+ */
+static int test_caps_blocked(int err)
+{
+	const struct io_uring_caps *caps, *again;
+	int status;
+	pid_t pid;
+
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return 1;
+	}
+	if (!pid) {
+		if (block_setup(SECCOMP_RET_ERRNO | err))
+			exit(2);
+		caps = io_uring_get_caps();
+		if (caps->probed || caps->features || caps->setup_flags)
+			exit(1);
+		if (block_setup(SECCOMP_RET_KILL))
+			exit(2);
+		again = io_uring_get_caps();
+		if (again != caps || io_uring_has_opcode(IORING_OP_NOP) ||
+		    io_uring_get_probe())
+			exit(1);
+		exit(0);
+	}
+
+	if (waitpid(pid, &status, 0) < 0) {
+		perror("waitpid");
+		return 1;
+	}
+	if (WIFSIGNALED(status)) {
+		fprintf(stderr, "probed again when blocked with %d\n", -err);
+		return 1;
+	}
+	if (WEXITSTATUS(status) == 2) {
+		fprintf(stdout, "seccomp not available, skipping\n");
+		return 0;
+	}
+	if (WEXITSTATUS(status)) {
+		fprintf(stderr, "bad caps with io_uring blocked by %d\n", -err);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * A probe that fails for lack of fds must not stick, once fds are available
+ * again the capabilities have to show up. Must run before anything else
+ * calls io_uring_get_caps().
+ */
+static int test_caps_retry(void)
+{
+	const struct io_uring_caps *caps;
+	struct io_uring_probe *p;
+	struct rlimit rlim, low;
+
+	if (getrlimit(RLIMIT_NOFILE, &rlim) < 0) {
+		perror("getrlimit");
+		return 1;
+	}
+	low = rlim;
+	low.rlim_cur = 0;
+	if (setrlimit(RLIMIT_NOFILE, &low) < 0) {
+		perror("setrlimit");
+		return 1;
+	}
+	caps = io_uring_get_caps();
+	p = io_uring_get_probe();
+	if (setrlimit(RLIMIT_NOFILE, &rlim) < 0) {
+		perror("setrlimit");
+		return 1;
+	}
+	if (caps->probed || p || io_uring_caps_opcode_supported(caps,
+							IORING_OP_NOP)) {
+		fprintf(stderr, "caps probed without fds\n");
+		return 1;
+	}
+
+	if (!io_uring_has_opcode(IORING_OP_NOP)) {
+		fprintf(stderr, "failed probe was cached\n");
+		return 1;
+	}
+	p = io_uring_get_probe();
+	if (!p) {
+		fprintf(stderr, "no probe after the limit was raised\n");
+		return 1;
+	}
+	io_uring_free_probe(p);
+	return 0;
+}
+
+/*
+ * The cached capabilities must agree with probing the ring directly, and
+ * not change between calls.
+ */
+static int test_caps(struct io_uring *ring)
+{
+	const struct io_uring_caps *caps;
+	struct io_uring_probe *p, *gp;
+	int op, ret = 1;
+
+	caps = io_uring_get_caps();
+	if (!caps->probed) {
+		fprintf(stderr, "caps not probed\n");
+		return 1;
+	}
+	if (io_uring_get_caps() != caps) {
+		fprintf(stderr, "caps table moved\n");
+		return 1;
+	}
+	if (caps->features != ring->features) {
+		fprintf(stderr, "caps features %x, ring %x\n", caps->features,
+				ring->features);
+		return 1;
+	}
+	if (!(caps->setup_flags & IORING_SETUP_CQSIZE)) {
+		fprintf(stderr, "CQSIZE not in setup flags %x\n",
+				caps->setup_flags);
+		return 1;
+	}
+
+	p = io_uring_get_probe_ring(ring);
+	gp = io_uring_get_probe();
+	if (!p || !gp) {
+		fprintf(stderr, "Failed getting probe data\n");
+		goto out;
+	}
+	if (gp->last_op != p->last_op || gp->ops_len != p->ops_len ||
+	    caps->last_op != p->last_op) {
+		fprintf(stderr, "last_op %u/%u/%u, ops_len %u/%u\n",
+				caps->last_op, gp->last_op, p->last_op,
+				gp->ops_len, p->ops_len);
+		goto out;
+	}
+	for (op = 0; op < 256; op++) {
+		int sup = io_uring_opcode_supported(p, op);
+
+		if (io_uring_has_opcode(op) != sup ||
+		    io_uring_opcode_supported(gp, op) != sup) {
+			fprintf(stderr, "opcode %d mismatch\n", op);
+			goto out;
+		}
+	}
+	if (io_uring_has_opcode(-1) || io_uring_has_opcode(256)) {
+		fprintf(stderr, "out of range opcode supported\n");
+		goto out;
+	}
+	ret = 0;
+out:
+	io_uring_free_probe(p);
+	io_uring_free_probe(gp);
+	return ret;
+}
+
 int main(int argc, char *argv[])
 {
 	struct io_uring ring;
@@ -130,6 +318,29 @@ int main(int argc, char *argv[])
 		return ret;
 	}
 
+	ret = test_caps_blocked(EPERM);
+	if (ret) {
+		fprintf(stderr, "test_caps_blocked EPERM failed\n");
+		return ret;
+	}
+
+	ret = test_caps_blocked(ENOSYS);
+	if (ret) {
+		fprintf(stderr, "test_caps_blocked ENOSYS failed\n");
+		return ret;
+	}
+
+	ret = test_caps_retry();
+	if (ret) {
+		fprintf(stderr, "test_caps_retry failed\n");
+		return ret;
+	}
+
+	ret = test_caps(&ring);
+	if (ret) {
+		fprintf(stderr, "test_caps failed\n");
+		return ret;
+	}
 
 	return 0;
 }
@@ -0,0 +1,312 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test multishot recv and recvmsg with ring provided buffers,
+ *		and the io_uring_recvmsg_*() helpers parsing the latter.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "liburing.h"
+
+#define BGID		1
+#define NR_BUFS		4
+#define BUF_SIZE	128
+
+static char bufs[NR_BUFS][BUF_SIZE];
+static int no_recv_multishot;
+
+static struct io_uring_buf_ring *setup_bufs(struct io_uring *ring)
+{
+	struct io_uring_buf_ring *br;
+	int i, ret, mask = io_uring_buf_ring_mask(NR_BUFS);
+
+	br = io_uring_setup_buf_ring(ring, NR_BUFS, BGID, 0, &ret);
+	if (!br) {
+		fprintf(stderr, "setup buf ring: %d\n", ret);
+		return NULL;
+	}
+	for (i = 0; i < NR_BUFS; i++)
+		io_uring_buf_ring_add(br, bufs[i], BUF_SIZE, i, mask, i);
+	io_uring_buf_ring_advance(br, NR_BUFS);
+	return br;
+}
+
+static int wait_recv(struct io_uring *ring, int *res, unsigned *flags)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return ret;
+	}
+	*res = cqe->res;
+	*flags = cqe->flags;
+	io_uring_cqe_seen(ring, cqe);
+	return 0;
+}
+
+static int test_recv(struct io_uring *ring)
+{
+	struct io_uring_buf_ring *br;
+	struct io_uring_sqe *sqe;
+	int fds[2], i, res, bid;
+	unsigned flags;
+	char msg[32];
+
+	br = setup_bufs(ring);
+	if (!br)
+		return 1;
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_recv_multishot(sqe, fds[0], NULL, 0, 0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BGID;
+	io_uring_submit(ring);
+
+	/* one cqe per chunk, each in a new buffer, handed back after use */
+	for (i = 0; i < 2 * NR_BUFS; i++) {
+		sprintf(msg, "message %d", i);
+		if (write(fds[1], msg, strlen(msg)) != (ssize_t) strlen(msg)) {
+			perror("write");
+			return 1;
+		}
+		if (wait_recv(ring, &res, &flags))
+			return 1;
+		if (res == -EINVAL && !i) {
+			no_recv_multishot = 1;
+			goto out;
+		}
+		if (res != (int) strlen(msg) ||
+		    !(flags & IORING_CQE_F_BUFFER) ||
+		    !(flags & IORING_CQE_F_MORE)) {
+			fprintf(stderr, "recv %d: %d, flags %x\n", i, res, flags);
+			return 1;
+		}
+		bid = flags >> IORING_CQE_BUFFER_SHIFT;
+		if (memcmp(bufs[bid], msg, res)) {
+			fprintf(stderr, "recv %d: data mismatch\n", i);
+			return 1;
+		}
+		io_uring_buf_ring_add(br, bufs[bid], BUF_SIZE, bid,
+				      io_uring_buf_ring_mask(NR_BUFS), 0);
+		io_uring_buf_ring_advance(br, 1);
+	}
+
+	/* the peer going away terminates the request */
+	close(fds[1]);
+	fds[1] = -1;
+	if (wait_recv(ring, &res, &flags))
+		return 1;
+	if (res != 0 || (flags & IORING_CQE_F_MORE)) {
+		fprintf(stderr, "recv after close: %d, flags %x\n", res, flags);
+		return 1;
+	}
+out:
+	close(fds[0]);
+	if (fds[1] != -1)
+		close(fds[1]);
+	return io_uring_free_buf_ring(ring, br, NR_BUFS, BGID);
+}
+
+static int udp_socket(struct sockaddr_in *addr)
+{
+	socklen_t len = sizeof(*addr);
+	int fd;
+
+	fd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (fd < 0) {
+		perror("socket");
+		return -1;
+	}
+	memset(addr, 0, sizeof(*addr));
+	addr->sin_family = AF_INET;
+	addr->sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (bind(fd, (struct sockaddr *) addr, sizeof(*addr)) < 0) {
+		perror("bind");
+		return -1;
+	}
+	if (getsockname(fd, (struct sockaddr *) addr, &len) < 0) {
+		perror("getsockname");
+		return -1;
+	}
+	return fd;
+}
+
+static int check_msg(void *buf, int res, struct msghdr *msg,
+		     struct sockaddr_in *src, const char *data, int len)
+{
+	struct io_uring_recvmsg_out *o;
+	struct sockaddr_in *name;
+	struct cmsghdr *cmsg;
+	unsigned int plen;
+
+	o = io_uring_recvmsg_validate(buf, res, msg);
+	if (!o) {
+		fprintf(stderr, "recvmsg: short buffer %d\n", res);
+		return 1;
+	}
+
+	name = io_uring_recvmsg_name(o);
+	if (o->namelen != sizeof(*src) || name->sin_port != src->sin_port) {
+		fprintf(stderr, "recvmsg: bad name, len %u\n", o->namelen);
+		return 1;
+	}
+
+	cmsg = io_uring_recvmsg_cmsg_firsthdr(o, msg);
+	if (!cmsg || cmsg->cmsg_level != IPPROTO_IP ||
+	    cmsg->cmsg_type != IP_PKTINFO) {
+		fprintf(stderr, "recvmsg: no pktinfo cmsg\n");
+		return 1;
+	}
+	if (io_uring_recvmsg_cmsg_nexthdr(o, msg, cmsg)) {
+		fprintf(stderr, "recvmsg: unexpected second cmsg\n");
+		return 1;
+	}
+
+	plen = io_uring_recvmsg_payload_length(o, res, msg);
+	if (o->payloadlen != (unsigned) len) {
+		fprintf(stderr, "recvmsg: payloadlen %u, wanted %d\n",
+				o->payloadlen, len);
+		return 1;
+	}
+	if (plen < (unsigned) len) {
+		/* didn't fit, must be flagged as truncated */
+		if (!(o->flags & MSG_TRUNC)) {
+			fprintf(stderr, "recvmsg: %u of %d bytes, no MSG_TRUNC\n",
+					plen, len);
+			return 1;
+		}
+	} else if (plen != (unsigned) len || (o->flags & MSG_TRUNC)) {
+		fprintf(stderr, "recvmsg: payload %u, flags %x\n", plen,
+				o->flags);
+		return 1;
+	}
+	if (memcmp(io_uring_recvmsg_payload(o, msg), data, plen)) {
+		fprintf(stderr, "recvmsg: data mismatch\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int test_recvmsg(struct io_uring *ring)
+{
+	struct io_uring_buf_ring *br;
+	struct io_uring_sqe *sqe;
+	struct sockaddr_in raddr, saddr;
+	struct msghdr msg;
+	int rfd, sfd, i, res, on = 1;
+	unsigned flags;
+	char data[BUF_SIZE];
+	int lens[NR_BUFS] = { 1, 16, 48, BUF_SIZE };
+
+	br = setup_bufs(ring);
+	if (!br)
+		return 1;
+	rfd = udp_socket(&raddr);
+	sfd = udp_socket(&saddr);
+	if (rfd < 0 || sfd < 0)
+		return 1;
+	if (setsockopt(rfd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)) < 0) {
+		perror("setsockopt");
+		return 1;
+	}
+
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_namelen = sizeof(struct sockaddr_in);
+	msg.msg_controllen = CMSG_SPACE(sizeof(struct in_pktinfo));
+
+	sqe = io_uring_get_sqe(ring);
+	/* MSG_TRUNC gets us the full datagram length in payloadlen */
+	io_uring_prep_recvmsg_multishot(sqe, rfd, &msg, MSG_TRUNC);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = BGID;
+	io_uring_submit(ring);
+
+	for (i = 0; i < BUF_SIZE; i++)
+		data[i] = i;
+
+	/* the last message is too big for what's left of the buffer */
+	for (i = 0; i < NR_BUFS; i++) {
+		if (sendto(sfd, data, lens[i], 0, (struct sockaddr *) &raddr,
+			   sizeof(raddr)) != lens[i]) {
+			perror("sendto");
+			return 1;
+		}
+		if (wait_recv(ring, &res, &flags))
+			return 1;
+		if (res < 0 || !(flags & IORING_CQE_F_BUFFER) ||
+		    !(flags & IORING_CQE_F_MORE)) {
+			fprintf(stderr, "recvmsg %d: %d, flags %x\n", i, res,
+					flags);
+			return 1;
+		}
+		if (check_msg(bufs[flags >> IORING_CQE_BUFFER_SHIFT], res,
+			      &msg, &saddr, data, lens[i]))
+			return 1;
+	}
+
+	/* no buffers handed back, which terminates the request */
+	if (sendto(sfd, data, 1, 0, (struct sockaddr *) &raddr,
+		   sizeof(raddr)) != 1) {
+		perror("sendto");
+		return 1;
+	}
+	if (wait_recv(ring, &res, &flags))
+		return 1;
+	if (res != -ENOBUFS || (flags & IORING_CQE_F_MORE)) {
+		fprintf(stderr, "recvmsg without buffers: %d, flags %x\n",
+				res, flags);
+		return 1;
+	}
+
+	close(rfd);
+	close(sfd);
+	return io_uring_free_buf_ring(ring, br, NR_BUFS, BGID);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_recv(&ring);
+	if (ret) {
+		fprintf(stderr, "test_recv failed\n");
+		return ret;
+	}
+	if (no_recv_multishot) {
+		fprintf(stdout, "Multishot recv not supported, skipping\n");
+		return 0;
+	}
+
+	ret = test_recvmsg(&ring);
+	if (ret) {
+		fprintf(stderr, "test_recvmsg failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
@@ -0,0 +1,226 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test bundled recv and send, where one request fills or
+ *		drains several buffers of a buffer ring.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "liburing.h"
+
+#define BGID		1
+#define NR_BUFS		8
+#define BUF_SIZE	64
+
+static char bufs[NR_BUFS][BUF_SIZE];
+
+static struct io_uring_buf_ring *setup_bufs(struct io_uring *ring,
+					    int nr_add)
+{
+	struct io_uring_buf_ring *br;
+	int i, ret, mask = io_uring_buf_ring_mask(NR_BUFS);
+
+	br = io_uring_setup_buf_ring(ring, NR_BUFS, BGID, 0, &ret);
+	if (!br) {
+		fprintf(stderr, "setup buf ring: %d\n", ret);
+		return NULL;
+	}
+	for (i = 0; i < nr_add; i++)
+		io_uring_buf_ring_add(br, bufs[i], BUF_SIZE, i, mask, i);
+	io_uring_buf_ring_advance(br, nr_add);
+	return br;
+}
+
+static int submit_wait(struct io_uring *ring, int *res, unsigned *flags,
+		       unsigned *nr_bufs)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	io_uring_submit(ring);
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return ret;
+	}
+	*res = cqe->res;
+	*flags = cqe->flags;
+	*nr_bufs = io_uring_cqe_bundle_count(cqe, BUF_SIZE);
+	io_uring_cqe_seen(ring, cqe);
+	return 0;
+}
+
+/*
+ * Receive 'len' bytes with bundled recvs, starting at buffer 'bid'. The
+ * kernel may split the data over several bundles, but they must use
+ * consecutive buffers, and at least one must span more than one buffer.
+ * Returns the next buffer ID to be used.
+ */
+static int recv_bundles(struct io_uring *ring, int fd, const char *data,
+			int len, int bid)
+{
+	struct io_uring_sqe *sqe;
+	unsigned flags, nr_bufs, max_bufs = 0;
+	int res, done = 0;
+
+	while (done < len) {
+		sqe = io_uring_get_sqe(ring);
+		io_uring_prep_recv_bundle(sqe, fd, BGID, 0);
+		if (submit_wait(ring, &res, &flags, &nr_bufs))
+			return -1;
+		if (res <= 0 || res > len - done ||
+		    (int) (flags >> IORING_CQE_BUFFER_SHIFT) != bid) {
+			fprintf(stderr, "recv bundle: %d, bid %u, wanted %d\n",
+					res, flags >> IORING_CQE_BUFFER_SHIFT,
+					bid);
+			return -1;
+		}
+		/* consecutive buffers are adjacent in bufs[] */
+		if (memcmp(bufs[bid], data + done, res)) {
+			fprintf(stderr, "recv bundle: data mismatch\n");
+			return -1;
+		}
+		if (nr_bufs > max_bufs)
+			max_bufs = nr_bufs;
+		bid += nr_bufs;
+		done += res;
+	}
+	if (len > BUF_SIZE && max_bufs < 2) {
+		fprintf(stderr, "recv bundle: no bundle spanned buffers\n");
+		return -1;
+	}
+	return bid;
+}
+
+static int test_recv(struct io_uring *ring, int *fds)
+{
+	struct io_uring_buf_ring *br;
+	char data[NR_BUFS * BUF_SIZE];
+	int i, bid, len;
+
+	br = setup_bufs(ring, NR_BUFS);
+	if (!br)
+		return 1;
+	for (i = 0; i < (int) sizeof(data); i++)
+		data[i] = i;
+
+	/* 3 full buffers and a bit of a 4th */
+	len = 3 * BUF_SIZE + 8;
+	if (write(fds[1], data, len) != len) {
+		perror("write");
+		return 1;
+	}
+	bid = recv_bundles(ring, fds[0], data, len, 0);
+	if (bid < 0)
+		return 1;
+
+	/* the next bundles continue after the partially used buffer */
+	len = 2 * BUF_SIZE;
+	if (bid + 2 > NR_BUFS) {
+		fprintf(stderr, "recv bundle: used %d buffers\n", bid);
+		return 1;
+	}
+	if (write(fds[1], data + 1, len) != len) {
+		perror("write");
+		return 1;
+	}
+	if (recv_bundles(ring, fds[0], data + 1, len, bid) < 0)
+		return 1;
+
+	return io_uring_free_buf_ring(ring, br, NR_BUFS, BGID);
+}
+
+static int test_send(struct io_uring *ring, int *fds)
+{
+	struct io_uring_buf_ring *br;
+	struct io_uring_sqe *sqe;
+	char data[NR_BUFS * BUF_SIZE];
+	unsigned flags, nr_bufs;
+	int i, res, len = 5 * BUF_SIZE;
+
+	/* queue 5 buffers worth of data for sending */
+	for (i = 0; i < NR_BUFS; i++)
+		memset(bufs[i], 'a' + i, BUF_SIZE);
+	br = setup_bufs(ring, 5);
+	if (!br)
+		return 1;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_send_bundle(sqe, fds[1], BGID, 0);
+	if (submit_wait(ring, &res, &flags, &nr_bufs))
+		return 1;
+	if (res != len || (flags >> IORING_CQE_BUFFER_SHIFT) != 0 ||
+	    nr_bufs != 5) {
+		fprintf(stderr, "send bundle: %d, bid %u, bufs %u\n", res,
+				flags >> IORING_CQE_BUFFER_SHIFT, nr_bufs);
+		return 1;
+	}
+	if (read(fds[0], data, sizeof(data)) != len) {
+		perror("read");
+		return 1;
+	}
+	for (i = 0; i < len; i++) {
+		if (data[i] != 'a' + i / BUF_SIZE) {
+			fprintf(stderr, "send bundle: data mismatch at %d\n", i);
+			return 1;
+		}
+	}
+
+	/* nothing left queued */
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_send_bundle(sqe, fds[1], BGID, 0);
+	if (submit_wait(ring, &res, &flags, &nr_bufs))
+		return 1;
+	if (res != -ENOBUFS) {
+		fprintf(stderr, "send bundle without buffers: %d\n", res);
+		return 1;
+	}
+
+	return io_uring_free_buf_ring(ring, br, NR_BUFS, BGID);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_params p = { };
+	struct io_uring ring;
+	int fds[2], ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init_params(8, &ring, &p);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+	if (!(p.features & IORING_FEAT_RECVSEND_BUNDLE)) {
+		fprintf(stdout, "Bundles not supported, skipping\n");
+		return 0;
+	}
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+		perror("socketpair");
+		return 1;
+	}
+
+	ret = test_recv(&ring, fds);
+	if (ret) {
+		fprintf(stderr, "test_recv failed\n");
+		return ret;
+	}
+
+	ret = test_send(&ring, fds);
+	if (ret) {
+		fprintf(stderr, "test_send failed\n");
+		return ret;
+	}
+
+	close(fds[0]);
+	close(fds[1]);
+	io_uring_queue_exit(&ring);
+	return 0;
+}
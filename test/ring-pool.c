@@ -0,0 +1,374 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test ring pools, where rings share an io-wq backend and idle
+ *		rings steal queued work from the backlog of busy ones.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include "liburing.h"
+
+#define NR_RINGS	4
+#define RING_SIZE	8
+#define NR_WORK		2000
+
+static int queue_nop(struct io_uring_pool_ring *pr, unsigned long data)
+{
+	struct io_uring_sqe sqe;
+
+	memset(&sqe, 0, sizeof(sqe));
+	io_uring_prep_nop(&sqe);
+	sqe.user_data = data;
+	return io_uring_pool_queue(pr, &sqe);
+}
+
+static int reap(struct io_uring_pool_ring *pr, unsigned nr,
+		unsigned long first)
+{
+	struct io_uring_cqe *cqe;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_wait_cqe(&pr->ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data != first + i) {
+			fprintf(stderr, "got user_data %lu, wanted %lu\n",
+					(unsigned long) cqe->user_data,
+					first + i);
+			return 1;
+		}
+		io_uring_cqe_seen(&pr->ring, cqe);
+	}
+	if (io_uring_cq_ready(&pr->ring)) {
+		fprintf(stderr, "unexpected completions\n");
+		return 1;
+	}
+	return 0;
+}
+
+static int test_steal(struct io_uring_pool *pool)
+{
+	struct io_uring_pool_ring *busy = &pool->rings[0];
+	struct io_uring_pool_ring *idle = &pool->rings[1];
+	int i, ret;
+
+	for (i = 0; i < RING_SIZE; i++) {
+		if (queue_nop(busy, i)) {
+			fprintf(stderr, "queue %d failed\n", i);
+			return 1;
+		}
+	}
+
+	/* the idle ring takes half, oldest first, and completes it */
+	ret = io_uring_pool_submit(idle);
+	if (ret != RING_SIZE / 2) {
+		fprintf(stderr, "idle submit: %d\n", ret);
+		return 1;
+	}
+	if (idle->nr_stolen != RING_SIZE / 2) {
+		fprintf(stderr, "stolen %u\n", idle->nr_stolen);
+		return 1;
+	}
+	if (reap(idle, RING_SIZE / 2, 0))
+		return 1;
+
+	ret = io_uring_pool_submit(busy);
+	if (ret != RING_SIZE / 2) {
+		fprintf(stderr, "busy submit: %d\n", ret);
+		return 1;
+	}
+	if (busy->nr_stolen) {
+		fprintf(stderr, "busy ring stole work\n");
+		return 1;
+	}
+	return reap(busy, RING_SIZE / 2, RING_SIZE / 2);
+}
+
+static int queue_link(struct io_uring_pool_ring *pr, unsigned long data,
+		      int fail, int link)
+{
+	struct io_uring_sqe sqe;
+
+	memset(&sqe, 0, sizeof(sqe));
+	if (fail)
+		io_uring_prep_read(&sqe, -1, NULL, 0, 0);
+	else
+		io_uring_prep_nop(&sqe);
+	if (link)
+		sqe.flags |= IOSQE_IO_LINK;
+	sqe.user_data = data;
+	return io_uring_pool_queue(pr, &sqe);
+}
+
+/* wait for 'nr' cqes with user_data from 'first' and results in 'res' */
+static int reap_res(struct io_uring_pool_ring *pr, unsigned nr,
+		    unsigned long first, const int *res)
+{
+	struct io_uring_cqe *cqe;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_wait_cqe(&pr->ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->user_data != first + i || cqe->res != res[i]) {
+			fprintf(stderr, "got %lu/%d, wanted %lu/%d\n",
+					(unsigned long) cqe->user_data,
+					cqe->res, first + i, res[i]);
+			return 1;
+		}
+		io_uring_cqe_seen(&pr->ring, cqe);
+	}
+	return 0;
+}
+
+/* link chains are never split, neither in the owner's ring nor by stealing */
+static int test_link(void)
+{
+	static const int nop_res[] = { 0, 0, 0 };
+	static const int chain_res[] = { -EBADF, -ECANCELED, -ECANCELED };
+	struct io_uring_params p = { };
+	struct io_uring_pool_ring *busy, *idle;
+	struct io_uring_pool pool;
+	int i, ret;
+
+	ret = io_uring_pool_init(&pool, 2, 4, &p);
+	if (ret) {
+		fprintf(stderr, "pool init: %d\n", ret);
+		return 1;
+	}
+	busy = &pool.rings[0];
+	idle = &pool.rings[1];
+
+	/* 3 nops and a chain of 2 that doesn't fit in the last slot */
+	for (i = 0; i < 3; i++)
+		queue_nop(busy, i);
+	queue_link(busy, 3, 1, 1);
+	queue_link(busy, 4, 0, 0);
+	ret = io_uring_pool_submit(busy);
+	if (ret != 3) {
+		fprintf(stderr, "submit before chain: %d\n", ret);
+		return 1;
+	}
+	if (reap_res(busy, 3, 0, nop_res))
+		return 1;
+	ret = io_uring_pool_submit(busy);
+	if (ret != 2) {
+		fprintf(stderr, "submit chain: %d\n", ret);
+		return 1;
+	}
+	if (reap_res(busy, 2, 3, chain_res))
+		return 1;
+
+	/* a chain that hasn't been ended yet stays in the backlog */
+	queue_link(busy, 5, 1, 1);
+	ret = io_uring_pool_submit(busy);
+	if (ret) {
+		fprintf(stderr, "submit open chain: %d\n", ret);
+		return 1;
+	}
+	queue_link(busy, 6, 0, 0);
+	ret = io_uring_pool_submit(busy);
+	if (ret != 2) {
+		fprintf(stderr, "submit closed chain: %d\n", ret);
+		return 1;
+	}
+	if (reap_res(busy, 2, 5, chain_res))
+		return 1;
+
+	/* half of the backlog is 2, which only leaves room for the nop */
+	queue_nop(busy, 7);
+	queue_link(busy, 8, 1, 1);
+	queue_link(busy, 9, 0, 1);
+	queue_link(busy, 10, 0, 0);
+	ret = io_uring_pool_submit(idle);
+	if (ret != 1) {
+		fprintf(stderr, "steal with chain: %d\n", ret);
+		return 1;
+	}
+	if (reap_res(idle, 1, 7, nop_res))
+		return 1;
+	ret = io_uring_pool_submit(busy);
+	if (ret != 3) {
+		fprintf(stderr, "submit chain after steal: %d\n", ret);
+		return 1;
+	}
+	if (reap_res(busy, 3, 8, chain_res))
+		return 1;
+
+	/* chains longer than the SQ ring could never be moved */
+	for (i = 0; i < 4; i++) {
+		if (queue_link(busy, 11 + i, 0, 1)) {
+			fprintf(stderr, "queue link %d failed\n", i);
+			return 1;
+		}
+	}
+	ret = queue_link(busy, 15, 0, 0);
+	if (ret != -EINVAL) {
+		fprintf(stderr, "queue chain longer than ring: %d\n", ret);
+		return 1;
+	}
+
+	io_uring_pool_exit(&pool);
+	return 0;
+}
+
+static int test_full(struct io_uring_pool *pool)
+{
+	struct io_uring_pool_ring *pr = &pool->rings[0];
+	unsigned i, backlog = pr->backlog_mask + 1;
+
+	for (i = 0; i < backlog; i++) {
+		if (queue_nop(pr, i)) {
+			fprintf(stderr, "queue %u failed\n", i);
+			return 1;
+		}
+	}
+	if (queue_nop(pr, i) != -EBUSY) {
+		fprintf(stderr, "queued to full backlog\n");
+		return 1;
+	}
+
+	/* drains into the SQ ring as space allows */
+	for (i = 0; i < backlog; i += RING_SIZE) {
+		if (io_uring_pool_submit(pr) != RING_SIZE) {
+			fprintf(stderr, "submit failed\n");
+			return 1;
+		}
+		if (reap(pr, RING_SIZE, i))
+			return 1;
+	}
+	return 0;
+}
+
+static unsigned long nr_done;
+static unsigned char seen[NR_WORK];
+
+struct worker {
+	struct io_uring_pool_ring *pr;
+	pthread_t thread;
+	int ret;
+};
+
+static void *worker_fn(void *data)
+{
+	struct worker *w = data;
+	unsigned long next = 0;
+
+	while (__atomic_load_n(&nr_done, __ATOMIC_ACQUIRE) < NR_WORK) {
+		struct io_uring_cqe *cqe;
+		unsigned head, nr = 0;
+
+		/* only the first worker gets work, the rest must steal */
+		while (!w->pr->index && next < NR_WORK &&
+		       !queue_nop(w->pr, next))
+			next++;
+
+		if (io_uring_pool_submit(w->pr) < 0) {
+			w->ret = 1;
+			break;
+		}
+		io_uring_for_each_cqe(&w->pr->ring, head, cqe) {
+			if (cqe->user_data >= NR_WORK ||
+			    seen[cqe->user_data]++) {
+				fprintf(stderr, "bad cqe %lu\n",
+						(unsigned long) cqe->user_data);
+				w->ret = 1;
+			}
+			nr++;
+		}
+		io_uring_cq_advance(&w->pr->ring, nr);
+		__atomic_add_fetch(&nr_done, nr, __ATOMIC_RELEASE);
+		if (!nr)
+			sched_yield();
+	}
+	return NULL;
+}
+
+static int test_threads(struct io_uring_pool *pool)
+{
+	struct worker workers[NR_RINGS];
+	int i, ret = 0;
+
+	for (i = 0; i < NR_RINGS; i++) {
+		workers[i].pr = &pool->rings[i];
+		workers[i].ret = 0;
+		pthread_create(&workers[i].thread, NULL, worker_fn,
+				&workers[i]);
+	}
+	for (i = 0; i < NR_RINGS; i++) {
+		pthread_join(workers[i].thread, NULL);
+		ret |= workers[i].ret;
+	}
+	for (i = 0; i < NR_WORK; i++) {
+		if (seen[i] != 1) {
+			fprintf(stderr, "work %d seen %d times\n", i, seen[i]);
+			return 1;
+		}
+	}
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_params p = { };
+	struct io_uring_pool pool;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	p.flags = IORING_SETUP_SQE128;
+	ret = io_uring_pool_init(&pool, NR_RINGS, RING_SIZE, &p);
+	if (ret != -EINVAL) {
+		fprintf(stderr, "pool with big sqes: %d\n", ret);
+		return 1;
+	}
+
+	memset(&p, 0, sizeof(p));
+	ret = io_uring_pool_init(&pool, NR_RINGS, RING_SIZE, &p);
+	if (ret) {
+		fprintf(stderr, "pool init: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_steal(&pool);
+	if (ret) {
+		fprintf(stderr, "test_steal failed\n");
+		return ret;
+	}
+
+	ret = test_link();
+	if (ret) {
+		fprintf(stderr, "test_link failed\n");
+		return ret;
+	}
+
+	ret = test_full(&pool);
+	if (ret) {
+		fprintf(stderr, "test_full failed\n");
+		return ret;
+	}
+
+	ret = test_threads(&pool);
+	if (ret) {
+		fprintf(stderr, "test_threads failed\n");
+		return ret;
+	}
+
+	io_uring_pool_exit(&pool);
+	return 0;
+}
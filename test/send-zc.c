@@ -0,0 +1,313 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test zero-copy sends, normal, from a registered buffer and
+ *		with sendmsg, and the tracker pairing their result and
+ *		notification cqes.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "liburing.h"
+
+#define BUF_SIZE	4096
+#define NR_SENDS	8
+#define UD_BASE		0x1000
+
+static char tx_buf[BUF_SIZE];
+static char rx_buf[BUF_SIZE];
+
+static int tcp_pair(int *rfd, int *sfd)
+{
+	struct sockaddr_in addr;
+	socklen_t len = sizeof(addr);
+	int lfd;
+
+	lfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (lfd < 0) {
+		perror("socket");
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (bind(lfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    getsockname(lfd, (struct sockaddr *) &addr, &len) < 0 ||
+	    listen(lfd, 1) < 0) {
+		perror("bind/listen");
+		return 1;
+	}
+	*sfd = socket(AF_INET, SOCK_STREAM, 0);
+	if (*sfd < 0 ||
+	    connect(*sfd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+		perror("connect");
+		return 1;
+	}
+	*rfd = accept(lfd, NULL, NULL);
+	if (*rfd < 0) {
+		perror("accept");
+		return 1;
+	}
+	close(lfd);
+	return 0;
+}
+
+static int recv_all(int fd, int len, char c)
+{
+	int ret, i, done = 0;
+
+	while (done < len) {
+		ret = read(fd, rx_buf, len - done);
+		if (ret <= 0) {
+			perror("read");
+			return 1;
+		}
+		for (i = 0; i < ret; i++) {
+			if (rx_buf[i] != c) {
+				fprintf(stderr, "data mismatch at %d\n",
+						done + i);
+				return 1;
+			}
+		}
+		done += ret;
+	}
+	return 0;
+}
+
+/*
+ * Reap cqes until all tracked sends completed. The tracker must only report
+ * a send as done once both its cqes have been seen.
+ */
+static int reap(struct io_uring *ring, struct io_uring_zc_tracker *t,
+		int nr, int len, char **data)
+{
+	struct io_uring_cqe *cqe;
+	int ret, res, done = 0, results = 0, notifs = 0;
+	void *ptr;
+
+	while (done < nr) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->flags & IORING_CQE_F_NOTIF) {
+			notifs++;
+		} else {
+			results++;
+			if (!(cqe->flags & IORING_CQE_F_MORE)) {
+				fprintf(stderr, "send without F_MORE: %d\n",
+						cqe->res);
+				return 1;
+			}
+		}
+		ret = io_uring_zc_tracker_cqe(t, cqe, &res, &ptr);
+		io_uring_cqe_seen(ring, cqe);
+		if (ret < 0) {
+			fprintf(stderr, "untracked cqe: %d\n", ret);
+			return 1;
+		}
+		if (!ret)
+			continue;
+		if (notifs != done + 1 || results < notifs) {
+			fprintf(stderr, "done before both cqes: %d/%d/%d\n",
+					done, results, notifs);
+			return 1;
+		}
+		/* sends may complete out of order, just check it's one of ours */
+		if (res != len || ptr < (void *) data[0] ||
+		    ptr > (void *) data[nr - 1]) {
+			fprintf(stderr, "send res %d, data %p\n", res, ptr);
+			return 1;
+		}
+		done++;
+	}
+	if (t->nr_free != t->nr_slots) {
+		fprintf(stderr, "slots leaked: %u free\n", t->nr_free);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_send_zc(struct io_uring *ring, int fixed)
+{
+	struct io_uring_zc_tracker t;
+	struct io_uring_sqe *sqe, dummy_sqe = { };
+	struct io_uring_cqe dummy_cqe = { };
+	char *data[NR_SENDS];
+	int rfd, sfd, i, ret, len = BUF_SIZE / NR_SENDS;
+
+	if (tcp_pair(&rfd, &sfd))
+		return 1;
+	ret = io_uring_zc_tracker_init(&t, NR_SENDS, UD_BASE);
+	if (ret) {
+		fprintf(stderr, "tracker init: %d\n", ret);
+		return 1;
+	}
+
+	memset(tx_buf, fixed ? 'f' : 'n', BUF_SIZE);
+	for (i = 0; i < NR_SENDS; i++) {
+		data[i] = tx_buf + i * len;
+		sqe = io_uring_get_sqe(ring);
+		if (fixed)
+			io_uring_prep_send_zc_fixed(sqe, sfd, data[i], len, 0,
+					IORING_SEND_ZC_REPORT_USAGE, 0);
+		else
+			io_uring_prep_send_zc(sqe, sfd, data[i], len, 0,
+					IORING_SEND_ZC_REPORT_USAGE);
+		ret = io_uring_zc_tracker_track(&t, sqe, data[i]);
+		if (ret != i) {
+			fprintf(stderr, "track %d: %d\n", i, ret);
+			return 1;
+		}
+	}
+	/* every slot is in flight */
+	ret = io_uring_zc_tracker_track(&t, &dummy_sqe, NULL);
+	if (ret != -EBUSY) {
+		fprintf(stderr, "track with no free slot: %d\n", ret);
+		return 1;
+	}
+	/* cqes of other requests aren't claimed */
+	dummy_cqe.user_data = UD_BASE + NR_SENDS;
+	ret = io_uring_zc_tracker_cqe(&t, &dummy_cqe, &i, NULL);
+	if (ret != -ENOENT) {
+		fprintf(stderr, "foreign cqe: %d\n", ret);
+		return 1;
+	}
+	io_uring_submit(ring);
+
+	if (recv_all(rfd, BUF_SIZE, fixed ? 'f' : 'n'))
+		return 1;
+	if (reap(ring, &t, NR_SENDS, len, data))
+		return 1;
+
+	io_uring_zc_tracker_exit(&t);
+	close(rfd);
+	close(sfd);
+	return 0;
+}
+
+static int test_sendmsg_zc(struct io_uring *ring)
+{
+	struct io_uring_zc_tracker t;
+	struct io_uring_sqe *sqe;
+	struct sockaddr_in addr;
+	socklen_t alen = sizeof(addr);
+	struct msghdr msg;
+	struct iovec iov;
+	char *data[2];
+	int rfd, sfd, ret;
+
+	rfd = socket(AF_INET, SOCK_DGRAM, 0);
+	sfd = socket(AF_INET, SOCK_DGRAM, 0);
+	if (rfd < 0 || sfd < 0) {
+		perror("socket");
+		return 1;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+	if (bind(rfd, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+	    getsockname(rfd, (struct sockaddr *) &addr, &alen) < 0) {
+		perror("bind");
+		return 1;
+	}
+	ret = io_uring_zc_tracker_init(&t, 2, UD_BASE);
+	if (ret) {
+		fprintf(stderr, "tracker init: %d\n", ret);
+		return 1;
+	}
+
+	memset(tx_buf, 'm', BUF_SIZE);
+	data[0] = tx_buf;
+	data[1] = tx_buf + 64;
+
+	/* one sendmsg_zc, and one send_zc to an explicit address */
+	iov.iov_base = data[0];
+	iov.iov_len = 64;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_name = &addr;
+	msg.msg_namelen = sizeof(addr);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_sendmsg_zc(sqe, sfd, &msg, 0);
+	io_uring_zc_tracker_track(&t, sqe, data[0]);
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_send_zc(sqe, sfd, data[1], 64, 0, 0);
+	io_uring_prep_send_set_addr(sqe, (struct sockaddr *) &addr,
+				    sizeof(addr));
+	io_uring_zc_tracker_track(&t, sqe, data[1]);
+	io_uring_submit(ring);
+
+	if (recv_all(rfd, 64, 'm') || recv_all(rfd, 64, 'm'))
+		return 1;
+	if (reap(ring, &t, 2, 64, data))
+		return 1;
+
+	io_uring_zc_tracker_exit(&t);
+	close(rfd);
+	close(sfd);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring_probe *p;
+	struct io_uring ring;
+	struct iovec iov;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(32, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	p = io_uring_get_probe_ring(&ring);
+	if (!p || !io_uring_opcode_supported(p, IORING_OP_SEND_ZC) ||
+	    !io_uring_opcode_supported(p, IORING_OP_SENDMSG_ZC)) {
+		fprintf(stdout, "Zero-copy send not supported, skipping\n");
+		return 0;
+	}
+	io_uring_free_probe(p);
+
+	ret = test_send_zc(&ring, 0);
+	if (ret) {
+		fprintf(stderr, "test_send_zc failed\n");
+		return ret;
+	}
+
+	iov.iov_base = tx_buf;
+	iov.iov_len = BUF_SIZE;
+	ret = io_uring_register_buffers(&ring, &iov, 1);
+	if (ret) {
+		fprintf(stderr, "register buffers: %d\n", ret);
+		return 1;
+	}
+	ret = test_send_zc(&ring, 1);
+	if (ret) {
+		fprintf(stderr, "test_send_zc fixed failed\n");
+		return ret;
+	}
+	io_uring_unregister_buffers(&ring);
+
+	ret = test_sendmsg_zc(&ring);
+	if (ret) {
+		fprintf(stderr, "test_sendmsg_zc failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
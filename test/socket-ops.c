@@ -0,0 +1,284 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test creating sockets through the ring, both as normal and
+ *		direct descriptors, and setting them up with the socket
+ *		commands and bind/listen, without any regular fds.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "liburing.h"
+
+#define NR_FILES	8
+#define LISTEN_SLOT	0
+#define CLIENT_SLOT	1
+
+static int no_socket;
+static int no_sock_cmd;
+static int no_bind;
+
+static int submit_wait(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	io_uring_submit(ring);
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return ret;
+	}
+	ret = cqe->res;
+	io_uring_cqe_seen(ring, cqe);
+	return ret;
+}
+
+static int test_socket(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_socket(sqe, AF_INET, SOCK_STREAM, 0, 0);
+	ret = submit_wait(ring);
+	if (ret == -EINVAL) {
+		no_socket = 1;
+		return 0;
+	} else if (ret < 0) {
+		fprintf(stderr, "socket: %d\n", ret);
+		return 1;
+	}
+	close(ret);
+	return 0;
+}
+
+static int test_socket_direct(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	int ret, slot;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_socket_direct(sqe, AF_INET, SOCK_STREAM, 0, 3, 0);
+	ret = submit_wait(ring);
+	if (ret) {
+		fprintf(stderr, "socket direct: %d\n", ret);
+		return 1;
+	}
+
+	/* the kernel picks a free slot, so anything but 3 */
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_socket_direct_alloc(sqe, AF_INET, SOCK_STREAM, 0, 0);
+	slot = submit_wait(ring);
+	if (slot < 0 || slot >= NR_FILES || slot == 3) {
+		fprintf(stderr, "socket direct alloc: %d\n", slot);
+		return 1;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_close_direct(sqe, 3);
+	ret = submit_wait(ring);
+	if (ret) {
+		fprintf(stderr, "close direct: %d\n", ret);
+		return 1;
+	}
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_close_direct(sqe, slot);
+	ret = submit_wait(ring);
+	if (ret) {
+		fprintf(stderr, "close direct alloc: %d\n", ret);
+		return 1;
+	}
+	return 0;
+}
+
+static int test_sockopt(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqe;
+	int ret, val = 1;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_socket_direct(sqe, AF_INET, SOCK_STREAM, 0, 4, 0);
+	ret = submit_wait(ring);
+	if (ret) {
+		fprintf(stderr, "socket direct: %d\n", ret);
+		return 1;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cmd_sock(sqe, SOCKET_URING_OP_SETSOCKOPT, 4, SOL_SOCKET,
+			       SO_KEEPALIVE, &val, sizeof(val));
+	sqe->flags |= IOSQE_FIXED_FILE;
+	ret = submit_wait(ring);
+	if (ret == -EINVAL || ret == -EOPNOTSUPP) {
+		no_sock_cmd = 1;
+		return 0;
+	} else if (ret) {
+		fprintf(stderr, "setsockopt: %d\n", ret);
+		return 1;
+	}
+
+	val = 0;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cmd_sock(sqe, SOCKET_URING_OP_GETSOCKOPT, 4, SOL_SOCKET,
+			       SO_KEEPALIVE, &val, sizeof(val));
+	sqe->flags |= IOSQE_FIXED_FILE;
+	ret = submit_wait(ring);
+	if (ret != sizeof(val) || !val) {
+		fprintf(stderr, "getsockopt: %d, val %d\n", ret, val);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Set up a listener and a connected client in two batches of linked
+ * requests, all on direct descriptors.
+ */
+static int test_bind_listen(struct io_uring *ring)
+{
+	struct sockaddr_in addr;
+	struct io_uring_sqe *sqe;
+	struct io_uring_cqe *cqe;
+	int i, ret, val = 1;
+
+	memset(&addr, 0, sizeof(addr));
+	addr.sin_family = AF_INET;
+	addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	addr.sin_port = htons(0x4000 + (getpid() & 0x3fff));
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_socket_direct(sqe, AF_INET, SOCK_STREAM, 0, LISTEN_SLOT,
+				    0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_cmd_sock(sqe, SOCKET_URING_OP_SETSOCKOPT, LISTEN_SLOT,
+			       SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_bind(sqe, LISTEN_SLOT, (struct sockaddr *) &addr,
+			   sizeof(addr));
+	sqe->flags |= IOSQE_FIXED_FILE | IOSQE_IO_LINK;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_listen(sqe, LISTEN_SLOT, 16);
+	sqe->flags |= IOSQE_FIXED_FILE;
+
+	ret = io_uring_submit_and_wait(ring, 4);
+	if (ret != 4) {
+		fprintf(stderr, "submit listener: %d\n", ret);
+		return 1;
+	}
+	for (i = 0; i < 4; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		ret = cqe->res;
+		io_uring_cqe_seen(ring, cqe);
+		if (i == 2 && ret == -EINVAL) {
+			no_bind = 1;
+		} else if (ret && !(no_bind && ret == -ECANCELED)) {
+			fprintf(stderr, "listener setup %d: %d\n", i, ret);
+			return 1;
+		}
+	}
+	if (no_bind)
+		return 0;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_socket_direct(sqe, AF_INET, SOCK_STREAM, 0, CLIENT_SLOT,
+				    0);
+	sqe->flags |= IOSQE_IO_LINK;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_connect(sqe, CLIENT_SLOT, (struct sockaddr *) &addr,
+			      sizeof(addr));
+	sqe->flags |= IOSQE_FIXED_FILE;
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_accept_direct(sqe, LISTEN_SLOT, NULL, NULL, 0,
+				    IORING_FILE_INDEX_ALLOC);
+	sqe->flags |= IOSQE_FIXED_FILE;
+
+	ret = io_uring_submit_and_wait(ring, 3);
+	if (ret != 3) {
+		fprintf(stderr, "submit client: %d\n", ret);
+		return 1;
+	}
+	for (i = 0; i < 3; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->res < 0) {
+			fprintf(stderr, "client setup: %d\n", cqe->res);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(8, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_socket(&ring);
+	if (ret) {
+		fprintf(stderr, "test_socket failed\n");
+		return ret;
+	}
+	if (no_socket) {
+		fprintf(stdout, "Socket opcode not supported, skipping\n");
+		return 0;
+	}
+
+	ret = io_uring_register_files_sparse(&ring, NR_FILES);
+	if (ret) {
+		fprintf(stdout, "Sparse file table not supported, skipping\n");
+		return 0;
+	}
+
+	ret = test_socket_direct(&ring);
+	if (ret) {
+		fprintf(stderr, "test_socket_direct failed\n");
+		return ret;
+	}
+
+	ret = test_sockopt(&ring);
+	if (ret) {
+		fprintf(stderr, "test_sockopt failed\n");
+		return ret;
+	}
+	if (no_sock_cmd) {
+		fprintf(stdout, "Socket commands not supported, skipping\n");
+		return 0;
+	}
+
+	ret = test_bind_listen(&ring);
+	if (ret) {
+		fprintf(stderr, "test_bind_listen failed\n");
+		return ret;
+	}
+	if (no_bind)
+		fprintf(stdout, "Bind/listen not supported, skipping\n");
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
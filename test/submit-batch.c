@@ -0,0 +1,270 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test auto-submit batching, where getting sqes submits once a
+ *		batch is queued up and waits submit what's pending, without
+ *		splitting link chains, and the submit statistics.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liburing.h"
+
+#define RING_SIZE	16
+#define BATCH		4
+
+static int check_stats(struct io_uring *ring, unsigned submits, unsigned sqes,
+		       unsigned max_batch)
+{
+	struct io_uring_submit_stats stats;
+
+	io_uring_get_submit_stats(ring, &stats);
+	if (stats.submits != submits || stats.sqes != sqes ||
+	    stats.max_batch != max_batch) {
+		fprintf(stderr, "got %u/%u/%u stats, wanted %u/%u/%u\n",
+				stats.submits, stats.sqes, stats.max_batch,
+				submits, sqes, max_batch);
+		return 1;
+	}
+	return 0;
+}
+
+static int queue_nops(struct io_uring *ring, int nr)
+{
+	struct io_uring_sqe *sqe;
+	int i;
+
+	for (i = 0; i < nr; i++) {
+		sqe = io_uring_get_sqe(ring);
+		if (!sqe) {
+			fprintf(stderr, "get sqe failed\n");
+			return 1;
+		}
+		io_uring_prep_nop(sqe);
+	}
+	return 0;
+}
+
+static int reap(struct io_uring *ring, unsigned nr)
+{
+	struct io_uring_cqe *cqe;
+	unsigned i;
+	int ret;
+
+	for (i = 0; i < nr; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+	return 0;
+}
+
+static int test_get_sqe(struct io_uring *ring)
+{
+	/* a full batch is only submitted once the next sqe is asked for */
+	if (queue_nops(ring, BATCH))
+		return 1;
+	if (io_uring_cq_ready(ring)) {
+		fprintf(stderr, "batch submitted early\n");
+		return 1;
+	}
+	if (queue_nops(ring, 1))
+		return 1;
+	if (io_uring_cq_ready(ring) != BATCH) {
+		fprintf(stderr, "%u ready after batch\n",
+				io_uring_cq_ready(ring));
+		return 1;
+	}
+	if (check_stats(ring, 1, BATCH, BATCH))
+		return 1;
+
+	/* the wait submits the one left */
+	if (reap(ring, BATCH + 1))
+		return 1;
+	return check_stats(ring, 1, 1, 1);
+}
+
+static int test_get_sqes(struct io_uring *ring)
+{
+	struct io_uring_sqe *sqes[BATCH];
+	int i;
+
+	if (queue_nops(ring, BATCH))
+		return 1;
+	if (io_uring_get_sqes(ring, sqes, 2) != 2) {
+		fprintf(stderr, "get sqes failed\n");
+		return 1;
+	}
+	for (i = 0; i < 2; i++)
+		io_uring_prep_nop(sqes[i]);
+	if (io_uring_cq_ready(ring) != BATCH) {
+		fprintf(stderr, "%u ready after bulk get\n",
+				io_uring_cq_ready(ring));
+		return 1;
+	}
+
+	if (reap(ring, BATCH + 2))
+		return 1;
+	return check_stats(ring, 2, BATCH + 2, BATCH);
+}
+
+/* waiting submits what's queued even if a completion is already there */
+static int test_wait_ready(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	if (queue_nops(ring, 1))
+		return 1;
+	ret = io_uring_submit(ring);
+	if (ret != 1) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return 1;
+	}
+	if (check_stats(ring, 1, 1, 1))
+		return 1;
+
+	if (queue_nops(ring, 2))
+		return 1;
+	ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret) {
+		fprintf(stderr, "wait cqe: %d\n", ret);
+		return 1;
+	}
+	io_uring_cqe_seen(ring, cqe);
+	if (check_stats(ring, 1, 2, 2))
+		return 1;
+	return reap(ring, 2);
+}
+
+/* a link chain crossing the batch threshold is submitted in one piece */
+static int test_link(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	int i, ret;
+
+	if (queue_nops(ring, BATCH - 1))
+		return 1;
+	for (i = 0; i < 3; i++) {
+		sqe = io_uring_get_sqe(ring);
+		if (!sqe) {
+			fprintf(stderr, "get sqe failed\n");
+			return 1;
+		}
+		io_uring_prep_nop(sqe);
+		if (i < 2)
+			sqe->flags |= IOSQE_IO_LINK;
+	}
+	if (io_uring_cq_ready(ring)) {
+		fprintf(stderr, "link chain split\n");
+		return 1;
+	}
+
+	/* the chain ended, so the next get submits all of it */
+	if (queue_nops(ring, 1))
+		return 1;
+	if (io_uring_cq_ready(ring) != BATCH + 2) {
+		fprintf(stderr, "%u ready after chain\n",
+				io_uring_cq_ready(ring));
+		return 1;
+	}
+	if (check_stats(ring, 1, BATCH + 2, BATCH + 2))
+		return 1;
+
+	for (i = 0; i < BATCH + 3; i++) {
+		ret = io_uring_wait_cqe(ring, &cqe);
+		if (ret) {
+			fprintf(stderr, "wait cqe: %d\n", ret);
+			return 1;
+		}
+		if (cqe->res) {
+			fprintf(stderr, "cqe %d: %d\n", i, cqe->res);
+			return 1;
+		}
+		io_uring_cqe_seen(ring, cqe);
+	}
+	return check_stats(ring, 1, 1, 1);
+}
+
+/* explicit submits still work, and are accounted for */
+static int test_submit(struct io_uring *ring)
+{
+	int ret;
+
+	if (queue_nops(ring, 2))
+		return 1;
+	ret = io_uring_submit(ring);
+	if (ret != 2) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return 1;
+	}
+	if (reap(ring, 2))
+		return 1;
+	return check_stats(ring, 1, 2, 2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct io_uring ring;
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = io_uring_queue_init(RING_SIZE, &ring, 0);
+	if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = io_uring_set_submit_batch(&ring, RING_SIZE + 1);
+	if (ret != -EINVAL) {
+		fprintf(stderr, "batch bigger than ring: %d\n", ret);
+		return 1;
+	}
+	ret = io_uring_set_submit_batch(&ring, BATCH);
+	if (ret) {
+		fprintf(stderr, "set submit batch: %d\n", ret);
+		return 1;
+	}
+
+	ret = test_get_sqe(&ring);
+	if (ret) {
+		fprintf(stderr, "test_get_sqe failed\n");
+		return ret;
+	}
+
+	ret = test_get_sqes(&ring);
+	if (ret) {
+		fprintf(stderr, "test_get_sqes failed\n");
+		return ret;
+	}
+
+	ret = test_wait_ready(&ring);
+	if (ret) {
+		fprintf(stderr, "test_wait_ready failed\n");
+		return ret;
+	}
+
+	ret = test_link(&ring);
+	if (ret) {
+		fprintf(stderr, "test_link failed\n");
+		return ret;
+	}
+
+	ret = test_submit(&ring);
+	if (ret) {
+		fprintf(stderr, "test_submit failed\n");
+		return ret;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
@@ -0,0 +1,230 @@
+/* SPDX-License-Identifier: MIT */
+/*
+ * Description: test spinning on the CQ ring before sleeping for completions,
+ *		and the hit/miss accounting of it.
+ *
+ */
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "liburing.h"
+
+static void *writer_thread(void *data)
+{
+	int *fds = data;
+	char c = 'x';
+
+	usleep(10000);
+	if (write(fds[1], &c, 1) != 1)
+		perror("write");
+	return NULL;
+}
+
+static int check_stats(struct io_uring *ring, unsigned hits, unsigned misses)
+{
+	struct io_uring_spin_stats stats;
+
+	io_uring_get_wait_spin_stats(ring, &stats);
+	if (stats.hits != hits || stats.misses != misses) {
+		fprintf(stderr, "got %u hits, %u misses, wanted %u/%u\n",
+				stats.hits, stats.misses, hits, misses);
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * Read from a pipe that another thread writes to a bit later. With a big
+ * enough budget, the completion arrives while we're spinning.
+ */
+static int test_hit(struct io_uring *ring, int submit_and_wait)
+{
+	struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	pthread_t thread;
+	int fds[2], ret;
+	char buf;
+
+	if (pipe(fds) < 0) {
+		perror("pipe");
+		return 1;
+	}
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_read(sqe, fds[0], &buf, 1, 0);
+	sqe->user_data = 1;
+
+	if (!submit_and_wait) {
+		ret = io_uring_submit(ring);
+		if (ret != 1) {
+			fprintf(stderr, "submit: %d\n", ret);
+			return 1;
+		}
+	}
+
+	pthread_create(&thread, NULL, writer_thread, fds);
+
+	if (submit_and_wait)
+		ret = io_uring_submit_and_wait_timeout(ring, &cqe, 1, NULL,
+							NULL);
+	else
+		ret = io_uring_wait_cqe(ring, &cqe);
+	if (ret < 0) {
+		fprintf(stderr, "wait: %d\n", ret);
+		return 1;
+	}
+	if (cqe->res != 1 || cqe->user_data != 1) {
+		fprintf(stderr, "bad cqe res %d, data %lu\n", cqe->res,
+				(unsigned long) cqe->user_data);
+		return 1;
+	}
+	io_uring_cqe_seen(ring, cqe);
+	pthread_join(thread, NULL);
+
+	close(fds[0]);
+	close(fds[1]);
+	return check_stats(ring, 1, 0);
+}
+
+/*
+ * Spin budget runs out with nothing completing, the wait must go on to sleep
+ * and time out.
+ */
+static int test_miss(struct io_uring *ring)
+{
+	struct __kernel_timespec ts = { .tv_sec = 0, .tv_nsec = 10000000 };
+	struct io_uring_cqe *cqe;
+	int ret;
+
+	ret = io_uring_wait_cqes(ring, &cqe, 1, &ts, NULL);
+	if (ret != -ETIME) {
+		fprintf(stderr, "wait with nothing pending: %d\n", ret);
+		return 1;
+	}
+
+	return check_stats(ring, 0, 1);
+}
+
+/* completions that are already there don't need to spin */
+static int test_ready(struct io_uring *ring)
+{
+	struct io_uring_cqe *cqe;
+	struct io_uring_sqe *sqe;
+	int ret;
+
+	sqe = io_uring_get_sqe(ring);
+	io_uring_prep_nop(sqe);
+	ret = io_uring_submit_and_wait(ring, 1);
+	if (ret != 1) {
+		fprintf(stderr, "submit: %d\n", ret);
+		return 1;
+	}
+
+	ret = io_uring_wait_cqe_nr(ring, &cqe, 1);
+	if (ret) {
+		fprintf(stderr, "wait nop: %d\n", ret);
+		return 1;
+	}
+	io_uring_cqe_seen(ring, cqe);
+
+	return check_stats(ring, 0, 0);
+}
+
+static int test(unsigned flags)
+{
+	struct io_uring ring;
+	int ret;
+
+	ret = io_uring_queue_init(8, &ring, flags);
+	if (ret == -EINVAL)
+		return 0;
+	else if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	/* large enough to cover the writer's delay, and then some */
+	ret = io_uring_set_wait_spin(&ring, 1U << 30);
+	if (ret) {
+		fprintf(stderr, "set wait spin: %d\n", ret);
+		return 1;
+	}
+
+	if (test_hit(&ring, 0)) {
+		fprintf(stderr, "test_hit failed\n");
+		return 1;
+	}
+	if (test_hit(&ring, 1)) {
+		fprintf(stderr, "test_hit submit_and_wait failed\n");
+		return 1;
+	}
+	if (test_ready(&ring)) {
+		fprintf(stderr, "test_ready failed\n");
+		return 1;
+	}
+
+	io_uring_set_wait_spin(&ring, 100);
+	if (test_miss(&ring)) {
+		fprintf(stderr, "test_miss failed\n");
+		return 1;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
+
+static int test_no_spin(void)
+{
+	struct io_uring ring;
+	int ret;
+
+	ret = io_uring_queue_init(8, &ring, IORING_SETUP_SINGLE_ISSUER |
+					    IORING_SETUP_DEFER_TASKRUN);
+	if (ret == -EINVAL)
+		return 0;
+	else if (ret) {
+		fprintf(stderr, "ring setup failed: %d\n", ret);
+		return 1;
+	}
+
+	ret = io_uring_set_wait_spin(&ring, 100);
+	if (ret != -EINVAL) {
+		fprintf(stderr, "spin on DEFER_TASKRUN ring: %d\n", ret);
+		return 1;
+	}
+
+	io_uring_queue_exit(&ring);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	int ret;
+
+	if (argc > 1)
+		return 0;
+
+	ret = test(0);
+	if (ret) {
+		fprintf(stderr, "test default failed\n");
+		return ret;
+	}
+
+	ret = test(IORING_SETUP_SQPOLL);
+	if (ret) {
+		fprintf(stderr, "test sqpoll failed\n");
+		return ret;
+	}
+
+	ret = test_no_spin();
+	if (ret) {
+		fprintf(stderr, "test_no_spin failed\n");
+		return ret;
+	}
+
+	return 0;
+}